@@ -2,8 +2,24 @@
 #include <lmdbmap/map.hpp>
 #include <lmdbmap/environment.hpp>
 #include <lmdbmap/transaction.hpp>
+#include <lmdbmap/bulk_loader.hpp>
+#include <lmdbmap/async_writer.hpp>
+#include <lmdbmap/multimap.hpp>
+#include <lmdbmap/fixed_multimap.hpp>
+#include <lmdbmap/parallel.hpp>
+#include <lmdbmap/cache.hpp>
+#include <lmdbmap/indexed_map.hpp>
+#include <lmdbmap/compression.hpp>
+#include <lmdbmap/blob_map.hpp>
+#include <lmdbmap/sharded_map.hpp>
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
+#include <map>
+#include <random>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 class MapBenchmark : public benchmark::Fixture {
@@ -53,6 +69,44 @@ BENCHMARK_DEFINE_F(MapBenchmark, InsertBatchTxn)(benchmark::State& state) {
 }
 BENCHMARK_REGISTER_F(MapBenchmark, InsertBatchTxn)->Range(8, 8<<10);
 
+BENCHMARK_DEFINE_F(MapBenchmark, BulkLoad)(benchmark::State& state) {
+    for (auto _ : state) {
+        lmdbmap::bulk_loader<lmdbmap::map<int, std::string>> loader(*env, *map);
+        for (int i = state.range(0) - 1; i >= 0; --i) {
+            loader.add(i, "value");
+        }
+        benchmark::DoNotOptimize(loader.finish());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, BulkLoad)->Range(8, 8<<10);
+
+BENCHMARK_DEFINE_F(MapBenchmark, PutLargeValue)(benchmark::State& state) {
+    lmdbmap::map<int, std::vector<int>> large(*env, "bench_large");
+    std::vector<int> value(state.range(0));
+    for (auto _ : state) {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 64; ++i) large.put(txn, i, value);
+        txn.commit();
+    }
+    state.SetBytesProcessed(state.iterations() * 64 * state.range(0) * sizeof(int));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, PutLargeValue)->Range(256, 16<<10);
+
+BENCHMARK_DEFINE_F(MapBenchmark, InsertAsyncWriter)(benchmark::State& state) {
+    lmdbmap::async_writer writer(*env);
+    std::vector<std::future<void>> done;
+    for (auto _ : state) {
+        done.clear();
+        for (int i = 0; i < state.range(0); ++i) {
+            done.push_back(writer.put(*map, i, "value"));
+        }
+        for (auto& f : done) f.get();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, InsertAsyncWriter)->Range(8, 8<<10);
+
 BENCHMARK_DEFINE_F(MapBenchmark, GetSingleTxn)(benchmark::State& state) {
     // Pre-populate
     {
@@ -73,6 +127,26 @@ BENCHMARK_DEFINE_F(MapBenchmark, GetSingleTxn)(benchmark::State& state) {
 }
 BENCHMARK_REGISTER_F(MapBenchmark, GetSingleTxn)->Range(8, 8<<10);
 
+BENCHMARK_DEFINE_F(MapBenchmark, GetSingleReadTxn)(benchmark::State& state) {
+    // Pre-populate
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < state.range(0); ++i) {
+            map->put(txn, i, "value");
+        }
+        txn.commit();
+    }
+
+    int i = 0;
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        auto val = map->get(txn, i++ % state.range(0));
+        benchmark::DoNotOptimize(val);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_REGISTER_F(MapBenchmark, GetSingleReadTxn)->Range(8, 8<<10);
+
 BENCHMARK_DEFINE_F(MapBenchmark, GetBatchTxn)(benchmark::State& state) {
     // Pre-populate
     {
@@ -94,4 +168,725 @@ BENCHMARK_DEFINE_F(MapBenchmark, GetBatchTxn)(benchmark::State& state) {
 }
 BENCHMARK_REGISTER_F(MapBenchmark, GetBatchTxn)->Range(8, 8<<10);
 
-BENCHMARK_MAIN();
+BENCHMARK_DEFINE_F(MapBenchmark, GetManyTxn)(benchmark::State& state) {
+    // Pre-populate
+    std::vector<int> keys;
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < state.range(0); ++i) {
+            map->put(txn, i, "value");
+            keys.push_back((i * 7919) % state.range(0));
+        }
+        txn.commit();
+    }
+
+    for (auto _ : state) {
+        lmdbmap::transaction txn(*env, true);
+        auto vals = map->get_many(txn, keys);
+        benchmark::DoNotOptimize(vals);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, GetManyTxn)->Range(8, 8<<10);
+
+BENCHMARK_DEFINE_F(MapBenchmark, ScanBoundedRange)(benchmark::State& state) {
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 64 << 10; ++i) map->put(txn, i, "value");
+        txn.commit();
+    }
+    int lo = 0;
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        for (const auto& kv : map->range(txn, lo, lo + static_cast<int>(state.range(0)))) {
+            benchmark::DoNotOptimize(kv.second.data());
+        }
+        lo = (lo + 4096) % (32 << 10);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, ScanBoundedRange)->Range(8, 8<<10);
+
+BENCHMARK_DEFINE_F(MapBenchmark, ScanLatest)(benchmark::State& state) {
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 64 << 10; ++i) map->put(txn, i, "value");
+        txn.commit();
+    }
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        auto it = map->rbegin(txn);
+        for (int n = 0; n < state.range(0) && it != map->rend(txn); ++n, ++it) {
+            benchmark::DoNotOptimize(it.value().data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, ScanLatest)->Range(8, 8<<10);
+
+BENCHMARK_DEFINE_F(MapBenchmark, ParallelReduce)(benchmark::State& state) {
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 256 << 10; ++i) map->put(txn, i, "value");
+        txn.commit();
+    }
+    for (auto _ : state) {
+        size_t bytes = lmdbmap::parallel_reduce(*env, *map, size_t(0),
+            [](size_t acc, const std::pair<int, std::string>& kv) { return acc + kv.second.size(); },
+            [](size_t a, size_t b) { return a + b; }, static_cast<unsigned>(state.range(0)));
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * (256 << 10));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, ParallelReduce)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+// One tenant's rows out of 64, with std::tuple<tenant, user, ts> keys.
+BENCHMARK_DEFINE_F(MapBenchmark, ScanTenantPrefix)(benchmark::State& state) {
+    using key = std::tuple<std::string, std::uint32_t, std::uint64_t>;
+    lmdbmap::map<key, int> events(*env, "bench_events");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int t = 0; t < 64; ++t) {
+            for (std::uint32_t i = 0; i < state.range(0); ++i) {
+                events.put(txn, key{"tenant" + std::to_string(t), i % 16, i}, t);
+            }
+        }
+        txn.commit();
+    }
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        auto tenant = events.prefix_range(txn, "tenant42");
+        size_t n = 0;
+        for (auto it = tenant.begin(); it != tenant.end(); ++it) ++n;
+        benchmark::DoNotOptimize(n);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, ScanTenantPrefix)->Range(8, 8<<10);
+
+// Zipfian reads of 64k Boost-serialized values; range(0) is 0 for the
+// plain map and 1 for cached_map in front of it.
+static void BM_GetZipfian(benchmark::State& state) {
+    std::string db_path = "bench_db_zipf";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path);
+        lmdbmap::map<int, std::vector<int>> values(env, "bench_values");
+        lmdbmap::cached_map<lmdbmap::map<int, std::vector<int>>> cache(values);
+        const int keys = 64 << 10;
+        {
+            lmdbmap::transaction txn(env);
+            for (int i = 0; i < keys; ++i) values.put(txn, i, std::vector<int>(16, i));
+            txn.commit();
+        }
+        std::vector<double> weights(keys);
+        for (int i = 0; i < keys; ++i) weights[i] = 1.0 / (i + 1);
+        std::discrete_distribution<int> zipf(weights.begin(), weights.end());
+        std::mt19937 rng(42);
+        std::vector<int> samples(1 << 16);
+        for (int& k : samples) k = zipf(rng);
+
+        size_t i = 0;
+        for (auto _ : state) {
+            lmdbmap::read_txn txn(env);
+            int k = samples[i++ % samples.size()];
+            auto v = state.range(0) ? cache.get(txn, k) : values.get(txn, k);
+            benchmark::DoNotOptimize(v);
+        }
+        state.SetLabel(state.range(0) ? "cached" : "map");
+        state.SetItemsProcessed(state.iterations());
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_GetZipfian)->Arg(0)->Arg(1);
+
+struct bench_user {
+    std::string name;
+    int group = 0;
+
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int) {
+        ar & name & group;
+    }
+};
+
+// Finds the users of one group out of 1024; range(0) is 0 for a full scan
+// and 1 for find_by on an index.
+static void BM_FindByGroup(benchmark::State& state) {
+    using users_map = lmdbmap::indexed_map<int, bench_user, lmdbmap::index_by<&bench_user::group>>;
+    std::string db_path = "bench_db_indexed";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path);
+        users_map users(env, "bench_users");
+        {
+            lmdbmap::transaction txn(env);
+            for (int i = 0; i < 64 << 10; ++i) users.put(txn, i, bench_user{"user" + std::to_string(i), i % 1024});
+            txn.commit();
+        }
+        for (auto _ : state) {
+            lmdbmap::read_txn txn(env);
+            std::vector<std::pair<int, bench_user>> found;
+            if (state.range(0)) {
+                found = users.find_by<lmdbmap::index_by<&bench_user::group>>(txn, 42);
+            } else {
+                for (const auto& kv : users.primary().range(txn)) {
+                    if (kv.second.group == 42) found.push_back(kv);
+                }
+            }
+            benchmark::DoNotOptimize(found.data());
+        }
+        state.SetLabel(state.range(0) ? "index" : "scan");
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_FindByGroup)->Arg(0)->Arg(1);
+
+// Random reads of 64k JSON-like records; the bytes_per_value counter shows
+// how many database bytes each one takes.
+template<typename Codec>
+static void get_compressed(benchmark::State& state) {
+    std::string db_path = "bench_db_compressed";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path, size_t(1) << 30);
+        lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, Codec> records(env, "bench_records");
+        const int n = 64 << 10;
+        {
+            lmdbmap::transaction txn(env);
+            for (int i = 0; i < n; ++i) {
+                records.put(txn, i, "{\"id\":" + std::to_string(i) + ",\"status\":\"shipped\",\"carrier\":\"ups\"," +
+                                    "\"note\":\"" + std::string(200, 'a' + i % 26) + "\"}");
+            }
+            txn.commit();
+        }
+        {
+            lmdbmap::transaction txn(env, true);
+            MDB_stat stat;
+            mdb_stat(txn, records.dbi(), &stat);
+            size_t pages = stat.ms_branch_pages + stat.ms_leaf_pages + stat.ms_overflow_pages;
+            state.counters["bytes_per_value"] = double(pages) * stat.ms_psize / n;
+        }
+        std::mt19937 rng(42);
+        for (auto _ : state) {
+            lmdbmap::read_txn txn(env);
+            auto v = records.get(txn, static_cast<int>(rng() % n));
+            benchmark::DoNotOptimize(v);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK_TEMPLATE(get_compressed, lmdbmap::value_codec<std::string>);
+#if LMDBMAP_WITH_LZ4
+BENCHMARK_TEMPLATE(get_compressed, lmdbmap::compressed_codec<std::string,
+    lmdbmap::compression_config<lmdbmap::compression::lz4>>);
+#endif
+#if LMDBMAP_WITH_ZSTD
+BENCHMARK_TEMPLATE(get_compressed, lmdbmap::compressed_codec<std::string,
+    lmdbmap::compression_config<lmdbmap::compression::zstd>>);
+#endif
+
+// Reads range(0) bytes at a random offset of a 16 MiB value, from a blob_map
+// and from a map holding the value in one piece.
+static void BM_ReadBlobRange(benchmark::State& state) {
+    std::string db_path = "bench_db_blob";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path, size_t(1) << 30);
+        lmdbmap::blob_map<int> blobs(env, "bench_blobs");
+        const size_t size = size_t(16) << 20;
+        {
+            lmdbmap::transaction txn(env);
+            blobs.put(txn, 1, std::string(size, 'b'));
+            txn.commit();
+        }
+        std::mt19937_64 rng(42);
+        std::string buf(static_cast<size_t>(state.range(0)), '\0');
+        for (auto _ : state) {
+            lmdbmap::read_txn txn(env);
+            size_t n = blobs.read(txn, 1, rng() % (size - buf.size()), &buf[0], buf.size());
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_ReadBlobRange)->Range(4 << 10, 1 << 20);
+
+BENCHMARK_DEFINE_F(MapBenchmark, ReadLargeValueRange)(benchmark::State& state) {
+    const size_t size = size_t(16) << 20;
+    {
+        lmdbmap::transaction txn(*env);
+        map->put(txn, 1, std::string(size, 'b'));
+        txn.commit();
+    }
+    std::mt19937_64 rng(42);
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        auto value = map->get(txn, 1);
+        std::string part = value->substr(rng() % (size - state.range(0)), state.range(0));
+        benchmark::DoNotOptimize(part.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, ReadLargeValueRange)->Range(4 << 10, 1 << 20);
+
+template<typename Multimap>
+static void get_postings(benchmark::State& state, MapBenchmark& fixture) {
+    Multimap postings(*fixture.env, "bench_postings");
+    {
+        lmdbmap::transaction txn(*fixture.env);
+        for (std::uint32_t i = 0; i < state.range(0); ++i) postings.insert(txn, 1, i);
+        txn.commit();
+    }
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*fixture.env);
+        auto ids = postings.get(txn, 1);
+        benchmark::DoNotOptimize(ids.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_DEFINE_F(MapBenchmark, GetPostingsMultimap)(benchmark::State& state) {
+    get_postings<lmdbmap::multimap<int, std::uint32_t>>(state, *this);
+}
+BENCHMARK_REGISTER_F(MapBenchmark, GetPostingsMultimap)->Range(64, 64<<10);
+
+BENCHMARK_DEFINE_F(MapBenchmark, GetPostingsFixedMultimap)(benchmark::State& state) {
+    get_postings<lmdbmap::fixed_multimap<int, std::uint32_t>>(state, *this);
+}
+BENCHMARK_REGISTER_F(MapBenchmark, GetPostingsFixedMultimap)->Range(64, 64<<10);
+
+// Durability profiles, from safest to fastest.
+static lmdbmap::environment_options env_profile(int profile, const char** name) {
+    lmdbmap::environment_options options;
+    switch (profile) {
+    case 0: *name = "default"; break;
+    case 1: *name = "nometasync"; options.no_meta_sync(); break;
+    case 2: *name = "writemap"; options.write_map(); break;
+    case 3: *name = "writemap+nometasync"; options.write_map().no_meta_sync(); break;
+    case 4: *name = "writemap+mapasync"; options.write_map().map_async(); break;
+    case 5: *name = "nosync"; options.no_sync(); break;
+    default: *name = "nordahead+notls"; options.no_read_ahead().no_tls(); break;
+    }
+    return options;
+}
+
+static void BM_InsertProfile(benchmark::State& state) {
+    const char* name;
+    auto options = env_profile(static_cast<int>(state.range(0)), &name);
+    state.SetLabel(name);
+    std::string db_path = "bench_db_profile";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path, options);
+        lmdbmap::map<int, std::string> map(env, "bench_map");
+        int i = 0;
+        for (auto _ : state) {
+            lmdbmap::transaction txn(env);
+            map.put(txn, i++, "value");
+            txn.commit();
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_InsertProfile)->DenseRange(0, 6);
+
+static void BM_GetProfile(benchmark::State& state) {
+    const char* name;
+    auto options = env_profile(static_cast<int>(state.range(0)), &name);
+    state.SetLabel(name);
+    std::string db_path = "bench_db_profile";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path, options);
+        lmdbmap::map<int, std::string> map(env, "bench_map");
+        {
+            lmdbmap::transaction txn(env);
+            for (int i = 0; i < 1024; ++i) map.put(txn, i, "value");
+            txn.commit();
+        }
+        int i = 0;
+        for (auto _ : state) {
+            lmdbmap::read_txn txn(env);
+            auto val = map.get(txn, i++ % 1024);
+            benchmark::DoNotOptimize(val);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_GetProfile)->DenseRange(0, 6);
+
+// Multimap with range(0) values per key: inserting one key's values in a
+// transaction, reading them back, and erasing them (rolled back, so every
+// iteration erases the same number).
+BENCHMARK_DEFINE_F(MapBenchmark, MultimapInsertFanout)(benchmark::State& state) {
+    lmdbmap::multimap<int, std::uint32_t> mm(*env, "bench_multimap");
+    int key = 0;
+    for (auto _ : state) {
+        lmdbmap::transaction txn(*env);
+        for (std::uint32_t v = 0; v < state.range(0); ++v) mm.insert(txn, key, v);
+        txn.commit();
+        ++key;
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, MultimapInsertFanout)->RangeMultiplier(16)->Range(1, 4096);
+
+BENCHMARK_DEFINE_F(MapBenchmark, MultimapGetFanout)(benchmark::State& state) {
+    lmdbmap::multimap<int, std::uint32_t> mm(*env, "bench_multimap");
+    const int keys = 256;
+    {
+        lmdbmap::transaction txn(*env);
+        for (int k = 0; k < keys; ++k) {
+            for (std::uint32_t v = 0; v < state.range(0); ++v) mm.insert(txn, k, v);
+        }
+        txn.commit();
+    }
+    int k = 0;
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        auto values = mm.get(txn, k++ % keys);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, MultimapGetFanout)->RangeMultiplier(16)->Range(1, 4096);
+
+BENCHMARK_DEFINE_F(MapBenchmark, MultimapEraseFanout)(benchmark::State& state) {
+    lmdbmap::multimap<int, std::uint32_t> mm(*env, "bench_multimap");
+    const int keys = 256;
+    {
+        lmdbmap::transaction txn(*env);
+        for (int k = 0; k < keys; ++k) {
+            for (std::uint32_t v = 0; v < state.range(0); ++v) mm.insert(txn, k, v);
+        }
+        txn.commit();
+    }
+    int k = 0;
+    for (auto _ : state) {
+        lmdbmap::transaction txn(*env);
+        mm.erase(txn, k++ % keys);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, MultimapEraseFanout)->RangeMultiplier(16)->Range(1, 4096);
+
+// Iterates the first range(0) entries from begin().
+BENCHMARK_DEFINE_F(MapBenchmark, ScanForward)(benchmark::State& state) {
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < state.range(0); ++i) map->put(txn, i, "value");
+        txn.commit();
+    }
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        for (const auto& kv : map->range(txn)) {
+            benchmark::DoNotOptimize(kv.second.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, ScanForward)->Range(8, 64<<10);
+
+// Seeks to random keys of 64k, every other one missing; range(0) is 0 for
+// lower_bound and 1 for upper_bound.
+BENCHMARK_DEFINE_F(MapBenchmark, SeekBound)(benchmark::State& state) {
+    const int keys = 64 << 10;
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < keys; ++i) map->put(txn, 2 * i, "value");
+        txn.commit();
+    }
+    std::mt19937 rng(42);
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        int k = static_cast<int>(rng() % (2 * keys));
+        auto it = state.range(0) ? map->upper_bound(txn, k) : map->lower_bound(txn, k);
+        benchmark::DoNotOptimize(it);
+    }
+    state.SetLabel(state.range(0) ? "upper_bound" : "lower_bound");
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_REGISTER_F(MapBenchmark, SeekBound)->Arg(0)->Arg(1);
+
+// Readers on every benchmark thread while one background writer keeps
+// committing small transactions to the same map.
+static std::unique_ptr<lmdbmap::environment> contended_env;
+static std::unique_ptr<lmdbmap::map<int, std::string>> contended_map;
+static std::atomic<bool> contended_stop;
+static std::thread contended_writer;
+static const int contended_keys = 64 << 10;
+
+static void start_contended_writer(const benchmark::State&) {
+    std::filesystem::remove_all("bench_db_contended");
+    contended_env = std::make_unique<lmdbmap::environment>("bench_db_contended", size_t(1) << 30);
+    contended_map = std::make_unique<lmdbmap::map<int, std::string>>(*contended_env, "bench_map");
+    {
+        lmdbmap::transaction txn(*contended_env);
+        for (int i = 0; i < contended_keys; ++i) contended_map->put(txn, i, std::string(64, 'v'));
+        txn.commit();
+    }
+    contended_stop = false;
+    contended_writer = std::thread([] {
+        std::mt19937 rng(7);
+        while (!contended_stop) {
+            lmdbmap::transaction txn(*contended_env);
+            for (int n = 0; n < 16; ++n) {
+                contended_map->put(txn, static_cast<int>(rng() % contended_keys), std::string(64, 'w'));
+            }
+            txn.commit();
+        }
+    });
+}
+
+static void stop_contended_writer(const benchmark::State&) {
+    contended_stop = true;
+    contended_writer.join();
+    contended_map.reset();
+    contended_env.reset();
+    std::filesystem::remove_all("bench_db_contended");
+}
+
+static void BM_ReadersWithWriter(benchmark::State& state) {
+    std::mt19937 rng(static_cast<unsigned>(state.thread_index()));
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*contended_env);
+        auto v = contended_map->get(txn, static_cast<int>(rng() % contended_keys));
+        benchmark::DoNotOptimize(v);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadersWithWriter)
+    ->Setup(start_contended_writer)->Teardown(stop_contended_writer)
+    ->ThreadRange(1, 16)->UseRealTime();
+
+// Value sizes from 8 B to 1 MiB; values above ~2 KiB go to overflow pages.
+BENCHMARK_DEFINE_F(MapBenchmark, PutValueSize)(benchmark::State& state) {
+    std::string value(static_cast<size_t>(state.range(0)), 'v');
+    int i = 0;
+    for (auto _ : state) {
+        lmdbmap::transaction txn(*env);
+        map->put(txn, i++ % 64, value);
+        txn.commit();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, PutValueSize)->RangeMultiplier(8)->Range(8, 1<<20);
+
+BENCHMARK_DEFINE_F(MapBenchmark, GetValueSize)(benchmark::State& state) {
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 64; ++i) map->put(txn, i, std::string(static_cast<size_t>(state.range(0)), 'v'));
+        txn.commit();
+    }
+    int i = 0;
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        auto val = map->get(txn, i++ % 64);
+        benchmark::DoNotOptimize(val);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, GetValueSize)->RangeMultiplier(8)->Range(8, 1<<20);
+
+BENCHMARK_DEFINE_F(MapBenchmark, GetViewValueSize)(benchmark::State& state) {
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 64; ++i) map->put(txn, i, std::string(static_cast<size_t>(state.range(0)), 'v'));
+        txn.commit();
+    }
+    int i = 0;
+    for (auto _ : state) {
+        lmdbmap::read_txn txn(*env);
+        auto view = map->get_view(txn, i++ % 64);
+        benchmark::DoNotOptimize(view);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(MapBenchmark, GetViewValueSize)->RangeMultiplier(8)->Range(8, 1<<20);
+
+// Codec cost alone, without LMDB.
+static std::string sample(std::string*) { return std::string(100, 's'); }
+static int sample(int*) { return 123456; }
+static std::vector<int> sample(std::vector<int>*) { return std::vector<int>(64, 7); }
+static bench_user sample(bench_user*) { return bench_user{"user12345", 42}; }
+static std::tuple<std::uint32_t, std::string, std::int64_t> sample(std::tuple<std::uint32_t, std::string, std::int64_t>*) {
+    return {7, "tenant-user", -123456789};
+}
+
+template<typename Codec>
+static void encode_value(benchmark::State& state) {
+    using T = std::decay_t<decltype(Codec::decode(nullptr, 0))>;
+    T value = sample(static_cast<T*>(nullptr));
+    size_t bytes = 0;
+    for (auto _ : state) {
+        auto encoded = Codec::encode(value);
+        bytes = encoded.size();
+        benchmark::DoNotOptimize(encoded);
+    }
+    state.counters["encoded_bytes"] = double(bytes);
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename Codec>
+static void decode_value(benchmark::State& state) {
+    using T = std::decay_t<decltype(Codec::decode(nullptr, 0))>;
+    T original = sample(static_cast<T*>(nullptr));
+    auto encoded = Codec::encode(original);
+    std::string bytes(encoded.data(), encoded.size());
+    for (auto _ : state) {
+        T value = Codec::decode(bytes.data(), bytes.size());
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(encode_value, lmdbmap::key_codec<int>);
+BENCHMARK_TEMPLATE(encode_value, lmdbmap::key_codec<std::string>);
+BENCHMARK_TEMPLATE(encode_value, lmdbmap::key_codec<std::tuple<std::uint32_t, std::string, std::int64_t>>);
+BENCHMARK_TEMPLATE(encode_value, lmdbmap::value_codec<int>);
+BENCHMARK_TEMPLATE(encode_value, lmdbmap::value_codec<std::string>);
+BENCHMARK_TEMPLATE(encode_value, lmdbmap::value_codec<std::vector<int>>);
+BENCHMARK_TEMPLATE(encode_value, lmdbmap::value_codec<bench_user>);
+BENCHMARK_TEMPLATE(decode_value, lmdbmap::key_codec<int>);
+BENCHMARK_TEMPLATE(decode_value, lmdbmap::key_codec<std::string>);
+BENCHMARK_TEMPLATE(decode_value, lmdbmap::key_codec<std::tuple<std::uint32_t, std::string, std::int64_t>>);
+BENCHMARK_TEMPLATE(decode_value, lmdbmap::value_codec<int>);
+BENCHMARK_TEMPLATE(decode_value, lmdbmap::value_codec<std::string>);
+BENCHMARK_TEMPLATE(decode_value, lmdbmap::value_codec<std::vector<int>>);
+BENCHMARK_TEMPLATE(decode_value, lmdbmap::value_codec<bench_user>);
+
+// Baselines for the same workload: range(0) is 0 for lmdbmap::map, 1 for
+// raw LMDB calls on the same encoding and 2 for std::map in memory.
+static const char* baseline_label(int64_t which) {
+    return which == 0 ? "lmdbmap" : which == 1 ? "raw_lmdb" : "std::map";
+}
+
+// Random point reads of 64k 100-byte values.
+static void BM_GetBaseline(benchmark::State& state) {
+    std::string db_path = "bench_db_baseline";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path);
+        lmdbmap::map<int, std::string> map(env, "bench_map");
+        std::map<int, std::string> memory;
+        const int keys = 64 << 10;
+        {
+            lmdbmap::transaction txn(env);
+            for (int i = 0; i < keys; ++i) {
+                map.put(txn, i, std::string(100, 'v'));
+                memory[i] = std::string(100, 'v');
+            }
+            txn.commit();
+        }
+        std::mt19937 rng(42);
+        for (auto _ : state) {
+            int k = static_cast<int>(rng() % keys);
+            if (state.range(0) == 0) {
+                lmdbmap::read_txn txn(env);
+                auto v = map.get(txn, k);
+                benchmark::DoNotOptimize(v);
+            } else if (state.range(0) == 1) {
+                lmdbmap::read_txn txn(env);
+                auto key = lmdbmap::key_codec<int>::encode(k);
+                MDB_val key_val = lmdbmap::to_mdb_val(key);
+                MDB_val data_val;
+                if (mdb_get(txn, map.dbi(), &key_val, &data_val) == 0) {
+                    std::string v(static_cast<const char*>(data_val.mv_data), data_val.mv_size);
+                    benchmark::DoNotOptimize(v);
+                }
+            } else {
+                auto it = memory.find(k);
+                std::string v = it->second;
+                benchmark::DoNotOptimize(v);
+            }
+        }
+        state.SetLabel(baseline_label(state.range(0)));
+        state.SetItemsProcessed(state.iterations());
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_GetBaseline)->DenseRange(0, 2);
+
+// Batches of 1024 puts of 100-byte values, one transaction per batch.
+static void BM_PutBaseline(benchmark::State& state) {
+    std::string db_path = "bench_db_baseline";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::environment env(db_path, size_t(1) << 30);
+        lmdbmap::map<int, std::string> map(env, "bench_map");
+        std::map<int, std::string> memory;
+        const std::string value(100, 'v');
+        int i = 0;
+        for (auto _ : state) {
+            if (state.range(0) == 2) {
+                for (int n = 0; n < 1024; ++n) memory[i++ % (1 << 20)] = value;
+                continue;
+            }
+            lmdbmap::transaction txn(env);
+            for (int n = 0; n < 1024; ++n, ++i) {
+                if (state.range(0) == 0) {
+                    map.put(txn, i % (1 << 20), value);
+                } else {
+                    auto key = lmdbmap::key_codec<int>::encode(i % (1 << 20));
+                    MDB_val key_val = lmdbmap::to_mdb_val(key);
+                    MDB_val data_val{value.size(), const_cast<char*>(value.data())};
+                    int rc = mdb_put(txn, map.dbi(), &key_val, &data_val, 0);
+                    if (rc != 0) state.SkipWithError(mdb_strerror(rc));
+                }
+            }
+            txn.commit();
+        }
+        state.SetLabel(baseline_label(state.range(0)));
+        state.SetItemsProcessed(state.iterations() * 1024);
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_PutBaseline)->DenseRange(0, 2);
+
+// Ingest of batches of 1024 small entries from 8 threads into a
+// sharded_map with range(0) shards. With one shard every commit waits for
+// the same writer lock.
+static void BM_ShardedIngest(benchmark::State& state) {
+    std::string db_path = "bench_db_sharded";
+    std::filesystem::remove_all(db_path);
+    {
+        lmdbmap::sharded_map<std::uint64_t, std::string> m(db_path, static_cast<size_t>(state.range(0)), "data",
+            lmdbmap::environment_options().map_size(size_t(1) << 30).no_meta_sync());
+        std::atomic<std::uint64_t> next{0};
+        for (auto _ : state) {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 8; ++t) {
+                threads.emplace_back([&] {
+                    std::vector<std::pair<std::uint64_t, std::string>> batch;
+                    std::uint64_t first = next.fetch_add(1024);
+                    for (std::uint64_t i = 0; i < 1024; ++i) batch.emplace_back(first + i, std::string(64, 'v'));
+                    m.put_many(batch);
+                });
+            }
+            for (auto& t : threads) t.join();
+        }
+        state.SetItemsProcessed(state.iterations() * 8 * 1024);
+    }
+    std::filesystem::remove_all(db_path);
+}
+BENCHMARK(BM_ShardedIngest)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+// Besides the console table, results can be written as JSON for comparing
+// releases (see the benchmark_json target):
+//
+//   ./benchmark_map --benchmark_out=results.json --benchmark_out_format=json
+int main(int argc, char** argv) {
+    benchmark::AddCustomContext("lmdb_version", MDB_VERSION_STRING);
+    benchmark::AddCustomContext("lmdbmap_metrics", LMDBMAP_METRICS ? "on" : "off");
+    benchmark::AddCustomContext("lmdbmap_check_views", LMDBMAP_CHECK_VIEWS ? "on" : "off");
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
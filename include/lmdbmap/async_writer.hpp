@@ -0,0 +1,295 @@
+#pragma once
+#include "environment.hpp"
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+
+struct async_writer_options {
+    // Most operations applied in one write transaction.
+    size_t max_batch = 1000;
+    // Longest a batch waits for more operations before it is committed.
+    std::chrono::microseconds max_latency{1000};
+};
+
+// Group commit for many producer threads. Operations are pushed onto a
+// lock-free queue and applied by a single writer thread, many per write
+// transaction; each operation's future completes once the transaction that
+// applied it has committed. Under load, N concurrent writers cost one commit
+// (and one fsync) instead of N.
+//
+// When the map fills up, the map is grown and the batch applied again. If an
+// operation throws anything else, the batch is rolled back, that operation's
+// future gets the exception and the rest of the batch is applied again. So
+// an operation may run more than once and must not have side effects
+// outside the transaction.
+//
+// Growing the map waits for every other transaction on the environment to
+// end. Do not wait for a future while holding a transaction on the same
+// environment: the writer cannot grow the map until it ends, and after the
+// environment's resize_timeout the batch fails with map_full_error.
+class async_writer {
+public:
+    explicit async_writer(environment& env, async_writer_options options = {})
+        : env_(env), options_(options), thread_([this] { run(); }) {}
+
+    async_writer(const async_writer&) = delete;
+    async_writer& operator=(const async_writer&) = delete;
+
+    // Applies everything already submitted, then stops the writer thread.
+    ~async_writer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    // Runs fn(txn) in a batched write transaction. The future holds fn's
+    // result once that transaction has committed.
+    template<typename F>
+    auto submit(F fn) -> std::future<std::invoke_result_t<F&, transaction&>> {
+        auto* t = new task<F>(std::move(fn));
+        auto future = t->promise.get_future();
+        push(t);
+        return future;
+    }
+
+    // Runs fn(txn) in a batched write transaction, then calls done(error) on
+    // the writer thread: with nullptr once the transaction has committed, or
+    // with the exception fn threw. For callers that cannot block on a
+    // future; done should return quickly and must not throw.
+    template<typename F, typename Done>
+    void post(F fn, Done done) {
+        push(new callback_task<F, Done>(std::move(fn), std::move(done)));
+    }
+
+    template<typename Container>
+    std::future<void> put(Container& container, const typename Container::key_type& key,
+                          const typename Container::mapped_type& value) {
+        return submit([dbi = container.dbi(), k = encode<typename Container::key_codec_type>(key),
+                       v = encode<typename Container::value_codec_type>(value)](transaction& txn) mutable {
+            MDB_val key_val{k.size(), &k[0]};
+            MDB_val data_val{v.size(), &v[0]};
+            int rc = mdb_put(txn, dbi, &key_val, &data_val, 0);
+            if (rc != 0) detail::throw_error(rc);
+        });
+    }
+
+    template<typename Container>
+    std::future<void> erase(Container& container, const typename Container::key_type& key) {
+        return submit([dbi = container.dbi(), k = encode<typename Container::key_codec_type>(key)](transaction& txn) mutable {
+            MDB_val key_val{k.size(), &k[0]};
+            int rc = mdb_del(txn, dbi, &key_val, nullptr);
+            if (rc != 0 && rc != MDB_NOTFOUND) detail::throw_error(rc);
+        });
+    }
+
+    // Removes a single key/value pair from a multimap.
+    template<typename Container>
+    std::future<void> erase(Container& container, const typename Container::key_type& key,
+                            const typename Container::mapped_type& value) {
+        return submit([dbi = container.dbi(), k = encode<typename Container::key_codec_type>(key),
+                       v = encode<typename Container::value_codec_type>(value)](transaction& txn) mutable {
+            MDB_val key_val{k.size(), &k[0]};
+            MDB_val data_val{v.size(), &v[0]};
+            int rc = mdb_del(txn, dbi, &key_val, &data_val);
+            if (rc != 0 && rc != MDB_NOTFOUND) detail::throw_error(rc);
+        });
+    }
+
+private:
+    struct operation {
+        operation* next = nullptr;
+        virtual ~operation() = default;
+        virtual void run(transaction& txn) = 0;
+        virtual void reset() = 0;
+        virtual void complete() = 0;
+        virtual void fail(std::exception_ptr error) = 0;
+    };
+
+    template<typename F>
+    struct task : operation {
+        using result_type = std::invoke_result_t<F&, transaction&>;
+        using stored_type = std::conditional_t<std::is_void_v<result_type>, bool, result_type>;
+
+        F fn;
+        std::promise<result_type> promise;
+        std::optional<stored_type> result;
+
+        explicit task(F f) : fn(std::move(f)) {}
+
+        void run(transaction& txn) override {
+            if constexpr (std::is_void_v<result_type>) {
+                fn(txn);
+                result.emplace(true);
+            } else {
+                result.emplace(fn(txn));
+            }
+        }
+        void reset() override { result.reset(); }
+        void complete() override {
+            if constexpr (std::is_void_v<result_type>) {
+                promise.set_value();
+            } else {
+                promise.set_value(std::move(*result));
+            }
+        }
+        void fail(std::exception_ptr error) override { promise.set_exception(error); }
+    };
+
+    template<typename F, typename Done>
+    struct callback_task : operation {
+        F fn;
+        Done done;
+
+        callback_task(F f, Done d) : fn(std::move(f)), done(std::move(d)) {}
+
+        void run(transaction& txn) override { fn(txn); }
+        void reset() override {}
+        void complete() override { done(std::exception_ptr()); }
+        void fail(std::exception_ptr error) override { done(error); }
+    };
+
+    template<typename Codec, typename U>
+    std::string encode(const U& obj) const {
+        detail::encode_target target(env_);
+        auto bytes = Codec::encode(obj);
+        return std::string(bytes.data(), bytes.size());
+    }
+
+    environment& env_;
+    async_writer_options options_;
+    std::atomic<operation*> head_{nullptr};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+
+    // Lock-free push; only the producer that finds the queue empty takes the
+    // mutex, to wake the writer.
+    void push(operation* op) {
+        operation* head = head_.load(std::memory_order_relaxed);
+        do {
+            op->next = head;
+        } while (!head_.compare_exchange_weak(head, op, std::memory_order_release, std::memory_order_relaxed));
+        if (!head) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_.notify_one();
+        }
+    }
+
+    // Takes everything queued so far, oldest first.
+    void take(std::vector<operation*>& out) {
+        operation* op = head_.exchange(nullptr, std::memory_order_acquire);
+        size_t first = out.size();
+        for (; op; op = op->next) out.push_back(op);
+        std::reverse(out.begin() + static_cast<std::ptrdiff_t>(first), out.end());
+    }
+
+    void run() {
+        std::vector<operation*> pending;
+        for (;;) {
+            take(pending);
+            if (pending.empty()) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (stop_ && !head_.load()) return;
+                wake_.wait(lock, [&] { return stop_ || head_.load() != nullptr; });
+                continue;
+            }
+
+            // Collect until the batch is full or its oldest entry is due.
+            auto deadline = std::chrono::steady_clock::now() + options_.max_latency;
+            while (pending.size() < options_.max_batch) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (stop_) break;
+                if (!wake_.wait_until(lock, deadline, [&] { return stop_ || head_.load() != nullptr; })) break;
+                lock.unlock();
+                take(pending);
+            }
+
+            size_t n = std::min(pending.size(), options_.max_batch);
+            std::vector<operation*> batch(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(n));
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(n));
+            apply(batch);
+        }
+    }
+
+    void apply(std::vector<operation*>& batch) {
+        while (!batch.empty()) {
+            size_t failed = batch.size();
+            std::exception_ptr error;
+            size_t seen = env_.map_size();
+            bool full = false;
+            try {
+                transaction txn(env_);
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    try {
+                        batch[i]->run(txn);
+                    } catch (const map_full_error&) {
+                        throw;
+                    } catch (...) {
+                        failed = i;
+                        throw;
+                    }
+                }
+                txn.commit();
+            } catch (const map_full_error&) {
+                full = true;
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            if (full) {
+                // Grow the map and apply the same batch again.
+                try {
+                    env_.grow(seen);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                if (!error) {
+                    for (operation* op : batch) op->reset();
+                    continue;
+                }
+            }
+
+            if (!error) {
+                for (operation* op : batch) {
+                    op->complete();
+                    delete op;
+                }
+                return;
+            }
+            if (failed == batch.size()) {
+                // Could not begin, commit or grow: the whole batch failed.
+                for (operation* op : batch) {
+                    op->fail(error);
+                    delete op;
+                }
+                return;
+            }
+            batch[failed]->fail(error);
+            delete batch[failed];
+            batch.erase(batch.begin() + static_cast<std::ptrdiff_t>(failed));
+            for (operation* op : batch) op->reset();
+        }
+    }
+};
+
+}
@@ -0,0 +1,432 @@
+#pragma once
+#include "environment.hpp"
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include "view.hpp"
+#include "error.hpp"
+#include <lmdb.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace lmdbmap {
+
+// Large values split into fixed-size chunks, so they are written and read
+// piece by piece instead of as one contiguous string. A blob is stored as
+//
+//   (key, 0)      header: total size and chunk size, big-endian
+//   (key, 1..n)   chunk_size bytes each, the last one shorter
+//
+// where the key is escaped like a composite key string, so the sub-keys of
+// one blob are contiguous and never mix with another key's. Each chunk is
+// its own LMDB value, so reads hand out views of single chunks straight
+// from the memory map, and a read at an offset seeks to the chunk holding
+// it.
+template<typename Key, typename KeyCodec = key_codec<Key>>
+class blob_map {
+public:
+    using key_type = Key;
+    using key_codec_type = KeyCodec;
+
+    static constexpr std::uint64_t npos = std::numeric_limits<std::uint64_t>::max();
+
+    blob_map(environment& env, const std::string& name, size_t chunk_size = size_t(64) << 10)
+        : chunk_size_(chunk_size) {
+        if (chunk_size == 0 || chunk_size > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::invalid_argument("lmdbmap: invalid blob chunk size");
+        }
+        transaction txn(env);
+        int rc = mdb_dbi_open(txn, name.c_str(), MDB_CREATE, &dbi_);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        txn.commit();
+    }
+
+    // Writes a blob chunk by chunk, replacing any blob stored under key.
+    // Nothing is readable until close(); a writer dropped before close()
+    // leaves a blob without header, which reads as missing.
+    class writer {
+    public:
+        writer(blob_map& blobs, transaction& txn, const Key& key)
+            : blobs_(blobs), txn_(txn), prefix_(prefix_of(key)) {
+            blobs_.erase_prefix(txn_, prefix_);
+            buffer_.reserve(blobs_.chunk_size_);
+        }
+
+        writer(const writer&) = delete;
+        writer& operator=(const writer&) = delete;
+
+        void write(const void* data, size_t size) {
+            const char* p = static_cast<const char*>(data);
+            size_t chunk = blobs_.chunk_size_;
+            while (size > 0) {
+                if (buffer_.empty() && size >= chunk) {
+                    // Whole chunks go straight from the caller's buffer.
+                    flush(p, chunk);
+                    p += chunk;
+                    size -= chunk;
+                    continue;
+                }
+                size_t n = std::min(size, chunk - buffer_.size());
+                buffer_.append(p, n);
+                p += n;
+                size -= n;
+                if (buffer_.size() == chunk) {
+                    flush(buffer_.data(), buffer_.size());
+                    buffer_.clear();
+                }
+            }
+        }
+
+        void write(std::string_view bytes) { write(bytes.data(), bytes.size()); }
+
+        // Copies in until in reaches end of file.
+        void write(std::istream& in) {
+            std::string block(blobs_.chunk_size_, '\0');
+            while (in) {
+                in.read(&block[0], static_cast<std::streamsize>(block.size()));
+                write(block.data(), static_cast<size_t>(in.gcount()));
+            }
+        }
+
+        // Writes the last partial chunk and the header, and returns the size.
+        std::uint64_t close() {
+            if (!buffer_.empty()) {
+                flush(buffer_.data(), buffer_.size());
+                buffer_.clear();
+            }
+            std::string header(12, '\0');
+            detail::store_big_endian<std::uint64_t>(size_, &header[0]);
+            detail::store_big_endian<std::uint32_t>(static_cast<std::uint32_t>(blobs_.chunk_size_), &header[8]);
+            blobs_.put_chunk(txn_, prefix_, 0, header.data(), header.size());
+            return size_;
+        }
+
+    private:
+        blob_map& blobs_;
+        transaction& txn_;
+        std::string prefix_;
+        std::string buffer_;
+        std::uint32_t next_ = 1;
+        std::uint64_t size_ = 0;
+
+        void flush(const char* data, size_t size) {
+            if (next_ == std::numeric_limits<std::uint32_t>::max()) throw std::length_error("lmdbmap: blob too large");
+            blobs_.put_chunk(txn_, prefix_, next_++, data, size);
+            size_ += size;
+        }
+    };
+
+    // Size and chunking of a stored blob.
+    struct info {
+        std::uint64_t size;
+        std::uint32_t chunk_size;
+    };
+
+    // Views of the chunks covering [offset, offset + length), trimmed to
+    // the range. Each view points into the memory map; see byte_view for how
+    // long it stays valid.
+    class chunk_range {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = byte_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const byte_view*;
+            using reference = const byte_view&;
+
+            iterator() = default;
+
+            reference operator*() const { return view_; }
+            pointer operator->() const { return &view_; }
+
+            iterator& operator++() {
+                pos_ += view_.size();
+                load();
+                return *this;
+            }
+
+            iterator operator++(int) {
+                iterator tmp = *this;
+                ++(*this);
+                return tmp;
+            }
+
+            bool operator==(const iterator& other) const { return pos_ == other.pos_; }
+            bool operator!=(const iterator& other) const { return pos_ != other.pos_; }
+
+        private:
+            friend class chunk_range;
+
+            const chunk_range* range_ = nullptr;
+            std::uint64_t pos_ = 0;
+            byte_view view_;
+
+            iterator(const chunk_range* range, std::uint64_t pos) : range_(range), pos_(pos) { load(); }
+
+            void load() {
+                if (pos_ >= range_->end_) {
+                    pos_ = range_->end_;
+                    return;
+                }
+                view_ = range_->blobs_->view_at(*range_->txn_, range_->prefix_, range_->info_, pos_,
+                                                range_->end_ - pos_);
+            }
+        };
+
+        iterator begin() const { return iterator(this, begin_); }
+        iterator end() const {
+            iterator it;
+            it.pos_ = end_;
+            return it;
+        }
+
+    private:
+        friend class blob_map;
+
+        blob_map* blobs_;
+        transaction* txn_;
+        std::string prefix_;
+        info info_;
+        std::uint64_t begin_;
+        std::uint64_t end_;
+
+        chunk_range(blob_map* blobs, transaction* txn, std::string prefix, info i, std::uint64_t begin,
+                    std::uint64_t end)
+            : blobs_(blobs), txn_(txn), prefix_(std::move(prefix)), info_(i), begin_(begin), end_(end) {}
+    };
+
+    // Reads a blob through std::istream. The get area is the current chunk
+    // in the memory map, so nothing is copied until the caller reads, and
+    // seekg moves to the chunk holding the new position. A missing blob
+    // sets failbit. Must not outlive txn.
+    class istream : public std::istream {
+    public:
+        istream(blob_map& blobs, transaction& txn, const Key& key)
+            : std::istream(nullptr), buf_(blobs, txn, prefix_of(key)) {
+            rdbuf(&buf_);
+            if (!buf_.found()) setstate(std::ios::failbit);
+        }
+
+    private:
+        class streambuf : public std::streambuf {
+        public:
+            streambuf(blob_map& blobs, transaction& txn, std::string prefix)
+                : blobs_(blobs), txn_(txn), prefix_(std::move(prefix)) {
+                if (auto i = blobs_.read_info(txn_, prefix_)) {
+                    info_ = *i;
+                    found_ = true;
+                }
+            }
+
+            bool found() const { return found_; }
+
+        protected:
+            int_type underflow() override {
+                if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+                std::uint64_t pos = position();
+                if (pos >= info_.size) return traits_type::eof();
+                std::uint64_t index = pos / info_.chunk_size;
+                byte_view chunk = blobs_.chunk(txn_, prefix_, index + 1);
+                char* base = const_cast<char*>(chunk.data());
+                chunk_start_ = index * info_.chunk_size;
+                setg(base, base + (pos - chunk_start_), base + chunk.size());
+                return traits_type::to_int_type(*gptr());
+            }
+
+            std::streamsize showmanyc() override {
+                std::uint64_t pos = position();
+                return pos < info_.size ? static_cast<std::streamsize>(info_.size - pos) : -1;
+            }
+
+            pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override {
+                std::int64_t base = dir == std::ios::beg ? 0
+                                  : dir == std::ios::cur ? static_cast<std::int64_t>(position())
+                                                         : static_cast<std::int64_t>(info_.size);
+                return seekpos(pos_type(base + off), which);
+            }
+
+            pos_type seekpos(pos_type target, std::ios::openmode which) override {
+                std::int64_t pos = target;
+                if (!(which & std::ios::in) || pos < 0 || static_cast<std::uint64_t>(pos) > info_.size) {
+                    return pos_type(off_type(-1));
+                }
+                auto p = static_cast<std::uint64_t>(pos);
+                if (eback() && p >= chunk_start_ && p < chunk_start_ + (egptr() - eback())) {
+                    setg(eback(), eback() + (p - chunk_start_), egptr());
+                } else {
+                    // Loaded by the next underflow.
+                    setg(nullptr, nullptr, nullptr);
+                    next_ = p;
+                }
+                return target;
+            }
+
+        private:
+            blob_map& blobs_;
+            transaction& txn_;
+            std::string prefix_;
+            info info_{0, 1};
+            bool found_ = false;
+            std::uint64_t chunk_start_ = 0;
+            std::uint64_t next_ = 0;
+
+            std::uint64_t position() const {
+                return eback() ? chunk_start_ + static_cast<std::uint64_t>(gptr() - eback()) : next_;
+            }
+        };
+
+        streambuf buf_;
+    };
+
+    // Writes all of bytes as the blob stored under key.
+    void put(transaction& txn, const Key& key, std::string_view bytes) {
+        writer w(*this, txn, key);
+        w.write(bytes);
+        w.close();
+    }
+
+    void put(transaction& txn, const Key& key, std::istream& in) {
+        writer w(*this, txn, key);
+        w.write(in);
+        w.close();
+    }
+
+    std::optional<info> stat(transaction& txn, const Key& key) {
+        return read_info(txn, prefix_of(key));
+    }
+
+    std::optional<std::uint64_t> size(transaction& txn, const Key& key) {
+        auto i = stat(txn, key);
+        if (!i) return std::nullopt;
+        return i->size;
+    }
+
+    // Chunks covering up to length bytes from offset; empty when the blob is
+    // missing or offset is past its end.
+    chunk_range chunks(transaction& txn, const Key& key, std::uint64_t offset = 0, std::uint64_t length = npos) {
+        std::string prefix = prefix_of(key);
+        info i = read_info(txn, prefix).value_or(info{0, 1});
+        std::uint64_t begin = std::min(offset, i.size);
+        std::uint64_t end = begin + std::min(length, i.size - begin);
+        return chunk_range(this, &txn, std::move(prefix), i, begin, end);
+    }
+
+    // Copies up to size bytes from offset into out and returns how many.
+    size_t read(transaction& txn, const Key& key, std::uint64_t offset, void* out, size_t size) {
+        char* p = static_cast<char*>(out);
+        for (const byte_view& chunk : chunks(txn, key, offset, size)) {
+            std::memcpy(p, chunk.data(), chunk.size());
+            p += chunk.size();
+        }
+        return static_cast<size_t>(p - static_cast<char*>(out));
+    }
+
+    // The whole blob in one string, for blobs known to be small.
+    std::optional<std::string> get(transaction& txn, const Key& key) {
+        auto i = stat(txn, key);
+        if (!i) return std::nullopt;
+        std::string out;
+        out.reserve(static_cast<size_t>(i->size));
+        for (const byte_view& chunk : chunks(txn, key)) out.append(chunk.data(), chunk.size());
+        return out;
+    }
+
+    bool erase(transaction& txn, const Key& key) {
+        return erase_prefix(txn, prefix_of(key));
+    }
+
+    MDB_dbi dbi() const { return dbi_; }
+    size_t chunk_size() const { return chunk_size_; }
+
+private:
+    MDB_dbi dbi_;
+    size_t chunk_size_;
+
+    static std::string prefix_of(const Key& key) {
+        auto k = KeyCodec::encode(key);
+        std::string prefix;
+        detail::key_part<std::string>::append(prefix, std::string(k.data(), k.size()));
+        return prefix;
+    }
+
+    static std::string sub_key(const std::string& prefix, std::uint32_t index) {
+        std::string key = prefix;
+        key.resize(prefix.size() + 4);
+        detail::store_big_endian<std::uint32_t>(index, &key[prefix.size()]);
+        return key;
+    }
+
+    void put_chunk(transaction& txn, const std::string& prefix, std::uint32_t index, const char* data, size_t size) {
+        std::string k = sub_key(prefix, index);
+        MDB_val key_val{k.size(), &k[0]};
+        MDB_val data_val{size, const_cast<char*>(data)};
+        int rc = mdb_put(txn, dbi_, &key_val, &data_val, 0);
+        if (rc != 0) detail::throw_error(rc);
+    }
+
+    std::optional<byte_view> find_chunk(transaction& txn, const std::string& prefix, std::uint64_t index) {
+        std::string k = sub_key(prefix, static_cast<std::uint32_t>(index));
+        MDB_val key_val{k.size(), &k[0]};
+        MDB_val data_val;
+        int rc = mdb_get(txn, dbi_, &key_val, &data_val);
+        if (rc == MDB_NOTFOUND) return std::nullopt;
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        return byte_view(data_val, txn);
+    }
+
+    byte_view chunk(transaction& txn, const std::string& prefix, std::uint64_t index) {
+        auto c = find_chunk(txn, prefix, index);
+        if (!c) throw std::runtime_error("lmdbmap: blob chunk missing");
+        return *c;
+    }
+
+    std::optional<info> read_info(transaction& txn, const std::string& prefix) {
+        auto header = find_chunk(txn, prefix, 0);
+        if (!header) return std::nullopt;
+        if (header->size() != 12) throw std::runtime_error("lmdbmap: corrupt blob header");
+        info i{detail::load_big_endian<std::uint64_t>(header->data()),
+               detail::load_big_endian<std::uint32_t>(header->data() + 8)};
+        if (i.chunk_size == 0) throw std::runtime_error("lmdbmap: corrupt blob header");
+        return i;
+    }
+
+    // The part of the chunk holding pos, at most length bytes.
+    byte_view view_at(transaction& txn, const std::string& prefix, const info& i, std::uint64_t pos,
+                      std::uint64_t length) {
+        std::uint64_t index = pos / i.chunk_size;
+        byte_view c = chunk(txn, prefix, index + 1);
+        size_t skip = static_cast<size_t>(pos - index * i.chunk_size);
+        if (skip >= c.size()) throw std::runtime_error("lmdbmap: blob chunk too short");
+        size_t n = static_cast<size_t>(std::min<std::uint64_t>(c.size() - skip, length));
+        MDB_val part{n, const_cast<char*>(c.data() + skip)};
+        return byte_view(part, txn);
+    }
+
+    bool erase_prefix(transaction& txn, const std::string& prefix) {
+        MDB_cursor* cursor = txn.acquire_cursor(dbi_);
+        MDB_val k{prefix.size(), const_cast<char*>(prefix.data())}, v;
+        bool erased = false;
+        int rc = mdb_cursor_get(cursor, &k, &v, MDB_SET_RANGE);
+        while (rc == 0 && k.mv_size == prefix.size() + 4 && std::memcmp(k.mv_data, prefix.data(), prefix.size()) == 0) {
+            rc = mdb_cursor_del(cursor, 0);
+            if (rc != 0) break;
+            erased = true;
+            // After a delete MDB_NEXT lands on the entry that followed.
+            rc = mdb_cursor_get(cursor, &k, &v, MDB_NEXT);
+        }
+        txn.release_cursor(cursor);
+        if (rc != 0 && rc != MDB_NOTFOUND) detail::throw_error(rc);
+        return erased;
+    }
+};
+
+}
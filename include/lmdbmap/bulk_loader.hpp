@@ -0,0 +1,341 @@
+#pragma once
+#include "environment.hpp"
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include "error.hpp"
+#include <lmdb.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+
+struct bulk_load_options {
+    // Encoded bytes buffered in memory before a sorted run is spilled to disk.
+    size_t memory_limit = size_t(256) << 20;
+    // Entries written per write transaction.
+    size_t commit_every = size_t(1) << 20;
+    // Where spilled runs are written, in a directory of their own that is
+    // removed with the runs.
+    std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+};
+
+// Loads a map or multimap from unsorted input. Entries are encoded, sorted
+// by encoded key (and value, for multimaps) with an external merge sort that
+// spills runs to temp files, then written in key order with MDB_APPEND /
+// MDB_APPENDDUP so pages are filled completely instead of split.
+//
+// For a map, the last value added for a key wins. Loading into a non-empty
+// database works; entries that cannot be appended fall back to a normal put.
+template<typename Container>
+class bulk_loader {
+public:
+    using key_type = typename Container::key_type;
+    using mapped_type = typename Container::mapped_type;
+
+    bulk_loader(environment& env, Container& container, bulk_load_options options = {})
+        : env_(env), dbi_(container.dbi()), options_(std::move(options)) {
+        transaction txn(env, true);
+        unsigned int flags;
+        int rc = mdb_dbi_flags(txn, dbi_, &flags);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        dupsort_ = (flags & MDB_DUPSORT) != 0;
+    }
+
+    bulk_loader(const bulk_loader&) = delete;
+    bulk_loader& operator=(const bulk_loader&) = delete;
+
+    ~bulk_loader() {
+        remove_runs();
+    }
+
+    void add(const key_type& key, const mapped_type& value) {
+        auto k = Container::key_codec_type::encode(key);
+        detail::encode_target target(env_);
+        auto v = Container::value_codec_type::encode(value);
+        buffer_.push_back({std::string(k.data(), k.size()), std::string(v.data(), v.size())});
+        buffered_bytes_ += k.size() + v.size() + sizeof(entry);
+        if (buffered_bytes_ >= options_.memory_limit) spill();
+    }
+
+    template<typename Range>
+    void add(const Range& pairs) {
+        for (const auto& p : pairs) add(p.first, p.second);
+    }
+
+    // Writes everything added so far and returns the number of entries
+    // written. The loader can be reused afterwards.
+    size_t finish() {
+        sort_buffer();
+        std::vector<std::unique_ptr<source>> sources;
+        for (const auto& path : runs_) sources.push_back(std::make_unique<source>(path));
+        sources.push_back(std::make_unique<source>(buffer_));
+
+        auto after = [&](size_t a, size_t b) {
+            const entry& x = sources[a]->current;
+            const entry& y = sources[b]->current;
+            if (x.key != y.key) return x.key > y.key;
+            if (dupsort_ && x.value != y.value) return x.value > y.value;
+            return a < b;  // newer sources first
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(after);
+        for (size_t i = 0; i < sources.size(); ++i) {
+            if (sources[i]->next()) heap.push(i);
+        }
+
+        writer out(*this);
+        entry last;
+        bool has_last = false;
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            const entry& e = sources[i]->current;
+            if (!has_last || !same_slot(last, e)) {
+                out.write(e);
+                last = e;
+                has_last = true;
+            }
+            if (sources[i]->next()) heap.push(i);
+        }
+        size_t written = out.close();
+
+        sources.clear();
+        buffer_.clear();
+        buffered_bytes_ = 0;
+        remove_runs();
+        return written;
+    }
+
+private:
+    struct entry {
+        std::string key;
+        std::string value;
+    };
+
+    // A sorted run, either spilled to a file or still in memory.
+    struct source {
+        std::ifstream in;
+        const std::vector<entry>* mem = nullptr;
+        size_t pos = 0;
+        entry current;
+
+        explicit source(const std::filesystem::path& path) : in(path, std::ios::binary) {
+            if (!in) throw std::runtime_error("lmdbmap: cannot open bulk load run " + path.string());
+        }
+        explicit source(const std::vector<entry>& entries) : mem(&entries) {}
+
+        bool next() {
+            if (mem) {
+                if (pos == mem->size()) return false;
+                current = (*mem)[pos++];
+                return true;
+            }
+            return read_bytes(current.key) && read_bytes(current.value);
+        }
+
+        bool read_bytes(std::string& out) {
+            std::uint64_t size;
+            if (!in.read(reinterpret_cast<char*>(&size), sizeof(size))) return false;
+            out.resize(size);
+            if (!in.read(&out[0], static_cast<std::streamsize>(size))) {
+                throw std::runtime_error("lmdbmap: truncated bulk load run");
+            }
+            return true;
+        }
+    };
+
+    // Writes entries in order, committing every commit_every entries. The
+    // entries of the open transaction are kept so they can be written again
+    // if the map fills up and has to grow.
+    class writer {
+    public:
+        explicit writer(bulk_loader& loader) : loader_(loader) {}
+
+        ~writer() {
+            if (cursor_) txn_->release_cursor(cursor_);
+        }
+
+        void write(const entry& e) {
+            if (!txn_) begin();
+            pending_.push_back(e);
+            pending_bytes_ += e.key.size() + e.value.size() + sizeof(entry);
+            try {
+                put(pending_.back());
+            } catch (const map_full_error&) {
+                regrow();
+            }
+            ++written_;
+            if (pending_.size() >= loader_.options_.commit_every ||
+                pending_bytes_ >= loader_.options_.memory_limit) {
+                commit();
+            }
+        }
+
+        size_t close() {
+            commit();
+            return written_;
+        }
+
+    private:
+        bulk_loader& loader_;
+        std::unique_ptr<transaction> txn_;
+        MDB_cursor* cursor_ = nullptr;
+        size_t seen_ = 0;
+        std::vector<entry> pending_;
+        size_t pending_bytes_ = 0;
+        std::string prev_key_;
+        bool has_prev_ = false;
+        size_t written_ = 0;
+
+        void begin() {
+            seen_ = loader_.env_.map_size();
+            txn_ = std::make_unique<transaction>(loader_.env_);
+            cursor_ = txn_->acquire_cursor(loader_.dbi_);
+        }
+
+        void put(entry& e) {
+            MDB_val k{e.key.size(), &e.key[0]};
+            MDB_val v{e.value.size(), &e.value[0]};
+            unsigned int flags = MDB_APPEND;
+            if (loader_.dupsort_ && has_prev_ && prev_key_ == e.key) flags = MDB_APPENDDUP;
+            int rc = mdb_cursor_put(cursor_, &k, &v, flags);
+            if (rc == MDB_KEYEXIST) {
+                // Not past the end of what is already stored.
+                rc = mdb_cursor_put(cursor_, &k, &v, 0);
+            }
+            if (rc != 0) detail::throw_error(rc);
+            if (loader_.dupsort_) {
+                prev_key_ = e.key;
+                has_prev_ = true;
+            }
+        }
+
+        // Rolls back, grows the map and writes the open transaction's
+        // entries again.
+        void regrow() {
+            for (;;) {
+                if (txn_) abort();
+                loader_.env_.grow(seen_);
+                begin();
+                try {
+                    for (entry& e : pending_) put(e);
+                    return;
+                } catch (const map_full_error&) {
+                }
+            }
+        }
+
+        void abort() {
+            txn_->release_cursor(cursor_);
+            cursor_ = nullptr;
+            txn_.reset();
+            has_prev_ = false;
+        }
+
+        void commit() {
+            if (!txn_) return;
+            for (;;) {
+                txn_->release_cursor(cursor_);
+                cursor_ = nullptr;
+                try {
+                    txn_->commit();
+                    break;
+                } catch (const map_full_error&) {
+                    txn_.reset();
+                    regrow();
+                }
+            }
+            txn_.reset();
+            pending_.clear();
+            pending_bytes_ = 0;
+        }
+    };
+
+    environment& env_;
+    MDB_dbi dbi_;
+    bulk_load_options options_;
+    bool dupsort_ = false;
+    std::vector<entry> buffer_;
+    size_t buffered_bytes_ = 0;
+    std::vector<std::filesystem::path> runs_;
+    std::filesystem::path run_dir_;
+
+    bool same_slot(const entry& a, const entry& b) const {
+        return a.key == b.key && (!dupsort_ || a.value == b.value);
+    }
+
+    // Sorts the buffer and drops entries superseded by a later add().
+    void sort_buffer() {
+        std::stable_sort(buffer_.begin(), buffer_.end(), [&](const entry& a, const entry& b) {
+            if (a.key != b.key) return a.key < b.key;
+            return dupsort_ && a.value < b.value;
+        });
+        size_t out = 0;
+        for (size_t i = 0; i < buffer_.size(); ++i) {
+            if (i + 1 < buffer_.size() && same_slot(buffer_[i], buffer_[i + 1])) continue;
+            if (out != i) buffer_[out] = std::move(buffer_[i]);
+            ++out;
+        }
+        buffer_.resize(out);
+    }
+
+    void spill() {
+        sort_buffer();
+        if (run_dir_.empty()) make_run_dir();
+        std::filesystem::path path = run_dir_ / ("run_" + std::to_string(runs_.size()));
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("lmdbmap: cannot create bulk load run " + path.string());
+        runs_.push_back(path);
+        for (const entry& e : buffer_) {
+            write_bytes(out, e.key);
+            write_bytes(out, e.value);
+        }
+        out.close();
+        if (!out) throw std::runtime_error("lmdbmap: cannot write bulk load run " + path.string());
+        buffer_.clear();
+        buffered_bytes_ = 0;
+    }
+
+    static void write_bytes(std::ofstream& out, const std::string& bytes) {
+        std::uint64_t size = bytes.size();
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    // Like mkdtemp: create_directory fails when the name is taken, so no
+    // other loader, in this process or another, or files left behind by a
+    // crash, can end up among this loader's runs.
+    void make_run_dir() {
+        std::random_device random;
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "lmdbmap_bulk_%08x%08x", random(), random());
+            std::filesystem::path dir = options_.temp_dir / name;
+            std::error_code ec;
+            if (std::filesystem::create_directory(dir, ec)) {
+                run_dir_ = dir;
+                return;
+            }
+            if (ec) break;
+        }
+        throw std::runtime_error("lmdbmap: cannot create a bulk load directory in " + options_.temp_dir.string());
+    }
+
+    void remove_runs() {
+        std::error_code ec;
+        if (!run_dir_.empty()) std::filesystem::remove_all(run_dir_, ec);
+        run_dir_.clear();
+        runs_.clear();
+    }
+};
+
+}
@@ -0,0 +1,224 @@
+#pragma once
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+
+struct cache_options {
+    // Approximate memory for cached entries, split evenly between shards.
+    // An entry is charged its encoded key and value plus sizeof(T) and the
+    // bookkeeping around it.
+    size_t max_bytes = size_t(64) << 20;
+    // Independently locked parts of the cache.
+    size_t shards = 16;
+};
+
+struct cache_stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Keeps decoded values of a map in memory, so a hit skips both the B-tree
+// lookup and the codec. Each shard evicts with CLOCK: a hit only sets a
+// referenced bit under a shared lock, and eviction gives referenced entries
+// a second chance.
+//
+// Entries are stamped with the id of the snapshot they were read in
+// (mdb_txn_id) and only served to transactions reading that snapshot or a
+// later one. Writing a key through the cache drops its entry right away and
+// stops the shard from accepting values read in snapshots older than the
+// write transaction, so a stale value never gets back in, whether the write
+// commits or not. Writes that bypass the cache, including writes from other
+// processes, must be reported with invalidate() in their transaction.
+//
+// Only read-only transactions fill the cache; write transactions use it for
+// keys they have not written.
+template<typename Map>
+class cached_map {
+public:
+    using key_type = typename Map::key_type;
+    using mapped_type = typename Map::mapped_type;
+    using key_codec_type = typename Map::key_codec_type;
+    using value_codec_type = typename Map::value_codec_type;
+
+    explicit cached_map(Map& map, cache_options options = {})
+        : map_(map), shards_(std::max<size_t>(1, options.shards)) {
+        size_t budget = options.max_bytes / shards_.size();
+        for (auto& s : shards_) s.budget = budget;
+    }
+
+    cached_map(const cached_map&) = delete;
+    cached_map& operator=(const cached_map&) = delete;
+
+    std::optional<mapped_type> get(transaction& txn, const key_type& key) {
+        auto k = key_codec_type::encode(key);
+        std::string bytes(k.data(), k.size());
+        size_t snapshot = mdb_txn_id(txn);
+        shard& s = shard_for(bytes);
+        {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            auto it = s.entries.find(bytes);
+            if (it != s.entries.end() && snapshot >= it->second.stamp) {
+                it->second.referenced.store(true, std::memory_order_relaxed);
+                s.hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second.value;
+            }
+        }
+        s.misses.fetch_add(1, std::memory_order_relaxed);
+
+        MDB_val key_val{bytes.size(), &bytes[0]};
+        MDB_val data_val;
+        int rc = mdb_get(txn, map_.dbi(), &key_val, &data_val);
+        if (rc == MDB_NOTFOUND) return std::nullopt;
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        mapped_type value = value_codec_type::decode(data_val.mv_data, data_val.mv_size);
+        if (txn.read_only()) {
+            size_t charge = bytes.size() + data_val.mv_size + sizeof(mapped_type) + entry_overhead;
+            s.insert(std::move(bytes), value, snapshot, charge);
+        }
+        return value;
+    }
+
+    bool insert(transaction& txn, const key_type& key, const mapped_type& value) {
+        invalidate(txn, key);
+        return map_.insert(txn, key, value);
+    }
+
+    void put(transaction& txn, const key_type& key, const mapped_type& value) {
+        invalidate(txn, key);
+        map_.put(txn, key, value);
+    }
+
+    void erase(transaction& txn, const key_type& key) {
+        invalidate(txn, key);
+        map_.erase(txn, key);
+    }
+
+    // Drops key's entry because write transaction txn changes it.
+    void invalidate(transaction& txn, const key_type& key) {
+        auto k = key_codec_type::encode(key);
+        std::string bytes(k.data(), k.size());
+        size_t id = mdb_txn_id(txn);
+        shard& s = shard_for(bytes);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.entries.find(bytes);
+        if (it != s.entries.end()) s.remove(it->second.slot);
+        s.barrier = std::max(s.barrier, id);
+    }
+
+    // Drops every entry, e.g. after the map was changed without the cache.
+    void clear() {
+        for (auto& s : shards_) {
+            std::unique_lock<std::shared_mutex> lock(s.mutex);
+            s.entries.clear();
+            s.clock.clear();
+            s.hand = 0;
+            s.bytes = 0;
+        }
+    }
+
+    cache_stats stats() const {
+        cache_stats out;
+        for (auto& s : shards_) {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            out.hits += s.hits.load(std::memory_order_relaxed);
+            out.misses += s.misses.load(std::memory_order_relaxed);
+            out.entries += s.entries.size();
+            out.bytes += s.bytes;
+        }
+        return out;
+    }
+
+    Map& base() { return map_; }
+
+private:
+    // Hash node, bucket slot and clock slot.
+    static constexpr size_t entry_overhead = 64;
+
+    struct entry {
+        mapped_type value;
+        size_t stamp;
+        size_t charge;
+        size_t slot = 0;
+        std::atomic<bool> referenced{false};
+
+        entry(const mapped_type& v, size_t s, size_t c) : value(v), stamp(s), charge(c) {}
+    };
+
+    using entry_map = std::unordered_map<std::string, entry>;
+
+    struct shard {
+        mutable std::shared_mutex mutex;
+        entry_map entries;
+        // Entries in clock order; removal moves the last one into the gap.
+        std::vector<typename entry_map::iterator> clock;
+        size_t hand = 0;
+        size_t bytes = 0;
+        size_t budget = 0;
+        // Id of the newest write transaction that changed a key of this
+        // shard. Values read in older snapshots may be stale.
+        size_t barrier = 0;
+        std::atomic<std::uint64_t> hits{0};
+        std::atomic<std::uint64_t> misses{0};
+
+        void insert(std::string key, const mapped_type& value, size_t stamp, size_t charge) {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            if (stamp < barrier || charge > budget || entries.count(key)) return;
+            while (bytes + charge > budget) evict();
+            auto it = entries.emplace(std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                                      std::forward_as_tuple(value, stamp, charge)).first;
+            it->second.slot = clock.size();
+            clock.push_back(it);
+            bytes += charge;
+        }
+
+        void evict() {
+            for (;;) {
+                if (hand >= clock.size()) hand = 0;
+                entry& e = clock[hand]->second;
+                if (!e.referenced.exchange(false, std::memory_order_relaxed)) break;
+                ++hand;
+            }
+            remove(hand);
+        }
+
+        void remove(size_t slot) {
+            bytes -= clock[slot]->second.charge;
+            entries.erase(clock[slot]);
+            if (slot + 1 != clock.size()) {
+                clock[slot] = clock.back();
+                clock[slot]->second.slot = slot;
+            }
+            clock.pop_back();
+        }
+    };
+
+    Map& map_;
+    std::vector<shard> shards_;
+
+    shard& shard_for(const std::string& key) {
+        std::uint64_t h = std::hash<std::string>()(key);
+        // Mix, so the shard does not use the bits the hash table buckets on.
+        h = (h * 0x9E3779B97F4A7C15ull) >> 32;
+        return shards_[h % shards_.size()];
+    }
+};
+
+}
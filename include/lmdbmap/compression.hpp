@@ -0,0 +1,409 @@
+#pragma once
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include "error.hpp"
+#include <lmdb.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Set by CMake when it finds the library; see the README.
+#ifndef LMDBMAP_WITH_LZ4
+#define LMDBMAP_WITH_LZ4 0
+#endif
+#ifndef LMDBMAP_WITH_ZSTD
+#define LMDBMAP_WITH_ZSTD 0
+#endif
+
+#if LMDBMAP_WITH_LZ4
+#include <lz4.h>
+#endif
+#if LMDBMAP_WITH_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+namespace lmdbmap {
+
+// Stored as the first byte of every compressed_codec value, so values
+// written with different settings can be read side by side.
+enum class compression : std::uint8_t { none = 0, lz4 = 1, zstd = 2 };
+
+#if LMDBMAP_WITH_ZSTD
+constexpr compression default_compression = compression::zstd;
+#elif LMDBMAP_WITH_LZ4
+constexpr compression default_compression = compression::lz4;
+#else
+constexpr compression default_compression = compression::none;
+#endif
+
+template<compression Algorithm = default_compression, size_t Threshold = 128, int Level = 0>
+struct compression_config {
+    static constexpr compression algorithm = Algorithm;
+    // Values whose inner encoding is shorter than this are stored as is.
+    static constexpr size_t threshold = Threshold;
+    // zstd compression level or LZ4 acceleration; 0 is the library default.
+    static constexpr int level = Level;
+};
+
+namespace detail {
+
+[[noreturn]] inline void compression_error(const std::string& what) {
+    throw std::runtime_error("lmdbmap: " + what);
+}
+
+inline void store_as_is(const char* data, size_t size, std::string& out) {
+    out.assign(1, static_cast<char>(compression::none));
+    out.append(data, size);
+}
+
+#if LMDBMAP_WITH_ZSTD
+
+struct zstd_dictionary {
+    unsigned id;
+    ZSTD_CDict* cdict;
+    ZSTD_DDict* ddict;
+
+    zstd_dictionary(const std::string& bytes, int level)
+        : id(ZDICT_getDictID(bytes.data(), bytes.size())),
+          cdict(ZSTD_createCDict(bytes.data(), bytes.size(), level)),
+          ddict(ZSTD_createDDict(bytes.data(), bytes.size())) {
+        if (!cdict || !ddict) {
+            ZSTD_freeCDict(cdict);
+            ZSTD_freeDDict(ddict);
+            compression_error("invalid zstd dictionary");
+        }
+    }
+    ~zstd_dictionary() {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+    zstd_dictionary(const zstd_dictionary&) = delete;
+    zstd_dictionary& operator=(const zstd_dictionary&) = delete;
+};
+
+// The dictionaries loaded into one environment for one codec
+// configuration. New values use the newest; older values name theirs in the
+// zstd frame header.
+struct zstd_dictionary_set {
+    std::vector<std::shared_ptr<const zstd_dictionary>> all;
+
+    const zstd_dictionary* current() const { return all.empty() ? nullptr : all.back().get(); }
+};
+
+// Attached to the environment (see environment::attachment), so a value is
+// only compressed with a dictionary stored in the environment it is written
+// to, and the dictionaries go away with it. Replaced as a whole.
+template<typename Config>
+class zstd_dictionary_slot {
+public:
+    std::shared_ptr<const zstd_dictionary_set> get() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return set_;
+    }
+
+    void replace(std::shared_ptr<const zstd_dictionary_set> set) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        set_ = std::move(set);
+    }
+
+private:
+    std::mutex mutex_;
+    std::shared_ptr<const zstd_dictionary_set> set_;
+};
+
+// Every dictionary loaded into any environment, by id, for decoding, which
+// does not know the environment the value came from. ZDICT derives a
+// dictionary's id from its content, so any loaded dictionary with the id
+// in a frame header is the one the value was compressed with.
+class zstd_dictionary_index {
+public:
+    static zstd_dictionary_index& instance() {
+        static zstd_dictionary_index index;
+        return index;
+    }
+
+    void add(const std::shared_ptr<const zstd_dictionary>& dict) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loaded_.erase(std::remove_if(loaded_.begin(), loaded_.end(), [](const auto& d) { return d.expired(); }),
+                      loaded_.end());
+        loaded_.push_back(dict);
+    }
+
+    std::shared_ptr<const zstd_dictionary> find(unsigned id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& d : loaded_) {
+            auto dict = d.lock();
+            if (dict && dict->id == id) return dict;
+        }
+        return nullptr;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::weak_ptr<const zstd_dictionary>> loaded_;
+};
+
+struct zstd_contexts {
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+
+    zstd_contexts() = default;
+    ~zstd_contexts() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+    zstd_contexts(const zstd_contexts&) = delete;
+    zstd_contexts& operator=(const zstd_contexts&) = delete;
+};
+
+inline zstd_contexts& thread_zstd_contexts() {
+    thread_local zstd_contexts contexts;
+    return contexts;
+}
+
+#endif
+
+// Replaces out with the compressed value. out keeps its capacity, so
+// compressed_codec can reuse a scratch buffer.
+template<typename Config>
+void compress_into(const char* data, size_t size, std::string& out) {
+    if constexpr (Config::algorithm == compression::lz4) {
+#if LMDBMAP_WITH_LZ4
+        if (size < Config::threshold || size > size_t(LZ4_MAX_INPUT_SIZE)) return store_as_is(data, size, out);
+        int bound = LZ4_compressBound(static_cast<int>(size));
+        out.resize(5 + static_cast<size_t>(bound));
+        out[0] = static_cast<char>(compression::lz4);
+        store_big_endian<std::uint32_t>(static_cast<std::uint32_t>(size), &out[1]);
+        int n = LZ4_compress_fast(data, &out[5], static_cast<int>(size), bound, std::max(1, Config::level));
+        if (n <= 0 || size_t(n) + 4 >= size) return store_as_is(data, size, out);
+        out.resize(5 + static_cast<size_t>(n));
+#else
+        static_assert(Config::algorithm != compression::lz4, "lmdbmap: built without LZ4");
+#endif
+    } else if constexpr (Config::algorithm == compression::zstd) {
+#if LMDBMAP_WITH_ZSTD
+        if (size < Config::threshold) return store_as_is(data, size, out);
+        size_t bound = ZSTD_compressBound(size);
+        out.resize(1 + bound);
+        out[0] = static_cast<char>(compression::zstd);
+        environment* env = environment::of(encode_target::get());
+        auto set = env ? env->attachment<zstd_dictionary_slot<Config>>().get() : nullptr;
+        const zstd_dictionary* dict = set ? set->current() : nullptr;
+        ZSTD_CCtx* cctx = thread_zstd_contexts().cctx;
+        size_t n = dict ? ZSTD_compress_usingCDict(cctx, &out[1], bound, data, size, dict->cdict)
+                        : ZSTD_compressCCtx(cctx, &out[1], bound, data, size, Config::level);
+        if (ZSTD_isError(n)) compression_error(ZSTD_getErrorName(n));
+        if (n >= size) return store_as_is(data, size, out);
+        out.resize(1 + n);
+#else
+        static_assert(Config::algorithm != compression::zstd, "lmdbmap: built without zstd");
+#endif
+    } else {
+        store_as_is(data, size, out);
+    }
+}
+
+template<typename Config>
+std::string decompress(const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    if (size == 0) compression_error("empty compressed value");
+    switch (static_cast<compression>(p[0])) {
+    case compression::none:
+        return std::string(p + 1, size - 1);
+    case compression::lz4: {
+#if LMDBMAP_WITH_LZ4
+        if (size < 5) compression_error("truncated LZ4 value");
+        std::uint32_t raw = load_big_endian<std::uint32_t>(p + 1);
+        // LZ4 expands at most 255-fold, so a larger size is a corrupt header.
+        if (raw > std::uint32_t(LZ4_MAX_INPUT_SIZE) || std::uint64_t(raw) > std::uint64_t(size - 5) * 255) {
+            compression_error("corrupt LZ4 value");
+        }
+        std::string out(raw, '\0');
+        int n = LZ4_decompress_safe(p + 5, &out[0], static_cast<int>(size - 5), static_cast<int>(raw));
+        if (n < 0 || std::uint32_t(n) != raw) compression_error("corrupt LZ4 value");
+        return out;
+#else
+        compression_error("value is LZ4 compressed, but lmdbmap was built without LZ4");
+#endif
+    }
+    case compression::zstd: {
+#if LMDBMAP_WITH_ZSTD
+        unsigned long long raw = ZSTD_getFrameContentSize(p + 1, size - 1);
+        if (raw == ZSTD_CONTENTSIZE_ERROR || raw == ZSTD_CONTENTSIZE_UNKNOWN) compression_error("corrupt zstd value");
+        std::string out(static_cast<size_t>(raw), '\0');
+        ZSTD_DCtx* dctx = thread_zstd_contexts().dctx;
+        size_t n;
+        if (unsigned id = ZSTD_getDictID_fromFrame(p + 1, size - 1)) {
+            auto dict = zstd_dictionary_index::instance().find(id);
+            if (!dict) compression_error("zstd dictionary " + std::to_string(id) + " is not loaded");
+            n = ZSTD_decompress_usingDDict(dctx, &out[0], out.size(), p + 1, size - 1, dict->ddict);
+        } else {
+            n = ZSTD_decompressDCtx(dctx, &out[0], out.size(), p + 1, size - 1);
+        }
+        if (ZSTD_isError(n) || n != out.size()) compression_error("corrupt zstd value");
+        return out;
+#else
+        compression_error("value is zstd compressed, but lmdbmap was built without zstd");
+#endif
+    }
+    }
+    compression_error("unknown compression format");
+}
+
+}
+
+// Compresses what Inner encodes. Values shorter than Config::threshold,
+// or that do not shrink, are stored uncompressed behind the format byte.
+//
+//   using order_codec = lmdbmap::compressed_codec<order>;
+//   lmdbmap::map<int, order, lmdbmap::key_codec<int>, order_codec> orders(env, "orders");
+//
+// With zstd, a dictionary trained on a map's own values (see
+// train_dictionary) compresses small values much better. Dictionaries are
+// loaded per environment and Config, so maps in one environment that share
+// a Config share dictionaries; give each its own Config to keep them apart,
+// e.g. struct order_compression : lmdbmap::compression_config<> {}.
+template<typename T, typename Config = compression_config<>, typename Inner = value_codec<T>>
+struct compressed_codec {
+    using config_type = Config;
+
+    static std::string encode(const T& obj) {
+        std::string out;
+        encode_to(obj, out);
+        return out;
+    }
+
+    static void encode_to(const T& obj, std::string& out) {
+        if constexpr (detail::has_encode_to<Inner, T>::value) {
+            detail::scratch inner;
+            Inner::encode_to(obj, inner.bytes());
+            detail::compress_into<Config>(inner.bytes().data(), inner.bytes().size(), out);
+        } else {
+            auto bytes = Inner::encode(obj);
+            detail::compress_into<Config>(bytes.data(), bytes.size(), out);
+        }
+    }
+
+    static T decode(const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        if (size > 0 && static_cast<compression>(p[0]) == compression::none) return Inner::decode(p + 1, size - 1);
+        std::string bytes = detail::decompress<Config>(data, size);
+        return Inner::decode(bytes.data(), bytes.size());
+    }
+
+    // The value as Inner encoded it.
+    static std::string decompress(const void* data, size_t size) {
+        return detail::decompress<Config>(data, size);
+    }
+};
+
+#if LMDBMAP_WITH_ZSTD
+
+namespace detail {
+
+constexpr const char* dictionaries_dbi = "lmdbmap.dictionaries";
+using dictionary_key = key_codec<std::tuple<std::string, std::uint32_t>>;
+
+// Dictionaries stored under name, oldest first.
+inline std::vector<std::string> read_dictionaries(transaction& txn, const std::string& name) {
+    std::vector<std::string> out;
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, dictionaries_dbi, 0, &dbi);
+    if (rc == MDB_NOTFOUND) return out;
+    if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+
+    std::string prefix = dictionary_key::encode_prefix(name);
+    MDB_cursor* cursor = txn.acquire_cursor(dbi);
+    MDB_val k{prefix.size(), &prefix[0]}, v;
+    rc = mdb_cursor_get(cursor, &k, &v, MDB_SET_RANGE);
+    while (rc == 0 && k.mv_size >= prefix.size() && std::memcmp(k.mv_data, prefix.data(), prefix.size()) == 0) {
+        out.emplace_back(static_cast<const char*>(v.mv_data), v.mv_size);
+        rc = mdb_cursor_get(cursor, &k, &v, MDB_NEXT);
+    }
+    txn.release_cursor(cursor);
+    if (rc != 0 && rc != MDB_NOTFOUND) throw std::runtime_error(mdb_strerror(rc));
+    return out;
+}
+
+}
+
+// Trains a zstd dictionary of up to max_size bytes on up to max_samples
+// values spread over container, and stores it in the lmdbmap.dictionaries
+// database under name, next to earlier ones. Returns its id. Nothing uses
+// it until load_dictionaries is called after txn commits, so values never
+// refer to a dictionary that was rolled back.
+template<typename Container>
+unsigned train_dictionary(transaction& txn, Container& container, const std::string& name,
+                          size_t max_size = size_t(64) << 10, size_t max_samples = 10000) {
+    using codec = typename Container::value_codec_type;
+    size_t entries = container.size(txn);
+    size_t stride = std::max<size_t>(1, entries / std::max<size_t>(1, max_samples));
+
+    std::string samples;
+    std::vector<size_t> sizes;
+    MDB_cursor* cursor = txn.acquire_cursor(container.dbi());
+    MDB_val k, v;
+    int rc = mdb_cursor_get(cursor, &k, &v, MDB_FIRST);
+    try {
+        for (size_t i = 0; rc == 0; ++i, rc = mdb_cursor_get(cursor, &k, &v, MDB_NEXT)) {
+            if (i % stride != 0) continue;
+            std::string value = codec::decompress(v.mv_data, v.mv_size);
+            samples += value;
+            sizes.push_back(value.size());
+        }
+    } catch (...) {
+        txn.release_cursor(cursor);
+        throw;
+    }
+    txn.release_cursor(cursor);
+    if (rc != MDB_NOTFOUND) throw std::runtime_error(mdb_strerror(rc));
+
+    std::string dict(max_size, '\0');
+    size_t n = ZDICT_trainFromBuffer(&dict[0], dict.size(), samples.data(), sizes.data(),
+                                     static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(n)) detail::compression_error(std::string("cannot train dictionary: ") + ZDICT_getErrorName(n));
+    dict.resize(n);
+
+    MDB_dbi dbi;
+    rc = mdb_dbi_open(txn, detail::dictionaries_dbi, MDB_CREATE, &dbi);
+    if (rc != 0) detail::throw_error(rc);
+    auto seq = static_cast<std::uint32_t>(detail::read_dictionaries(txn, name).size());
+    std::string key = detail::dictionary_key::encode({name, seq});
+    MDB_val key_val{key.size(), &key[0]};
+    MDB_val data_val{dict.size(), &dict[0]};
+    rc = mdb_put(txn, dbi, &key_val, &data_val, 0);
+    if (rc != 0) detail::throw_error(rc);
+    return ZDICT_getDictID(dict.data(), dict.size());
+}
+
+// Makes Codec compress new values written to txn's environment with the
+// newest dictionary stored there under name, replacing what was loaded for
+// Codec's Config before, and decode values that use any of them. Returns
+// how many were loaded. Call it at startup and after a train_dictionary
+// commit, for every environment (every shard of a sharded_map) whose values
+// should use them.
+template<typename Codec>
+size_t load_dictionaries(transaction& txn, const std::string& name) {
+    using config = typename Codec::config_type;
+    environment* env = environment::of(mdb_txn_env(txn));
+    if (!env) throw std::logic_error("lmdbmap: load_dictionaries needs an lmdbmap::environment");
+    auto set = std::make_shared<detail::zstd_dictionary_set>();
+    for (const std::string& bytes : detail::read_dictionaries(txn, name)) {
+        auto dict = std::make_shared<const detail::zstd_dictionary>(bytes, config::level);
+        detail::zstd_dictionary_index::instance().add(dict);
+        set->all.push_back(std::move(dict));
+    }
+    env->attachment<detail::zstd_dictionary_slot<config>>().replace(set);
+    return set->all.size();
+}
+
+#endif
+
+}
@@ -0,0 +1,217 @@
+#pragma once
+#include "environment.hpp"
+#include "transaction.hpp"
+#include "async_writer.hpp"
+#include "io_pool.hpp"
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Awaitable reads and writes for C++20 coroutines. Without coroutine
+// support (e.g. in C++17 builds) this header declares nothing.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define LMDBMAP_HAS_COROUTINES 1
+#else
+#define LMDBMAP_HAS_COROUTINES 0
+#endif
+
+#if LMDBMAP_HAS_COROUTINES
+
+namespace lmdbmap {
+
+struct async_options {
+    // Threads that run reads, each with its own pooled read transaction.
+    size_t read_threads = 4;
+    // Batching of writes, see async_writer.
+    async_writer_options writer;
+    // Where a coroutine continues once its operation is done. By default a
+    // read resumes on the I/O thread that ran it and a write on one of the
+    // I/O threads; set this to hand the coroutine back to an executor.
+    std::function<void(std::coroutine_handle<>)> resume;
+};
+
+namespace detail {
+
+// Result of an operation, filled in on another thread before the awaiting
+// coroutine is resumed.
+template<typename R>
+class async_outcome {
+public:
+    // Calls fn(txn) and keeps its result; a retried write overwrites it.
+    template<typename F>
+    void run(F& fn, transaction& txn) {
+        if constexpr (std::is_void_v<R>) {
+            fn(txn);
+        } else {
+            value_.emplace(fn(txn));
+        }
+    }
+
+    void fail(std::exception_ptr error) { error_ = error; }
+
+    R take() {
+        if (error_) std::rethrow_exception(error_);
+        if constexpr (!std::is_void_v<R>) return std::move(*value_);
+    }
+
+private:
+    using stored_type = std::conditional_t<std::is_void_v<R>, bool, R>;
+    std::optional<stored_type> value_;
+    std::exception_ptr error_;
+};
+
+}
+
+class async_context;
+
+// co_await-able result of async_context::async_read. The operation starts
+// when it is awaited; an awaitable that is never awaited does nothing.
+template<typename F>
+class [[nodiscard]] read_awaitable {
+public:
+    using result_type = std::invoke_result_t<F&, transaction&>;
+
+    read_awaitable(async_context& ctx, F fn) : ctx_(ctx), fn_(std::move(fn)) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    result_type await_resume() { return outcome_.take(); }
+
+private:
+    async_context& ctx_;
+    F fn_;
+    detail::async_outcome<result_type> outcome_;
+};
+
+// co_await-able result of async_context::async_transaction.
+template<typename F>
+class [[nodiscard]] write_awaitable {
+public:
+    using result_type = std::invoke_result_t<F&, transaction&>;
+
+    write_awaitable(async_context& ctx, F fn) : ctx_(ctx), fn_(std::move(fn)) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    result_type await_resume() { return outcome_.take(); }
+
+private:
+    async_context& ctx_;
+    F fn_;
+    detail::async_outcome<result_type> outcome_;
+};
+
+// Runs reads on a fixed pool of I/O threads and writes on an async_writer,
+// so coroutines on event-loop threads never wait for the writer lock or a
+// page fault themselves:
+//
+//   lmdbmap::async_context io(env);
+//   co_await io.async_put(users, 1, "alice");
+//   std::optional<std::string> name = co_await io.async_get(users, 1);
+//
+// Keys and values are copied into the operation; containers must outlive
+// it. The context must outlive every operation awaited on it; destroying it
+// completes the operations already started.
+//
+// As with async_writer, do not co_await a write while the coroutine holds a
+// transaction on the same environment: a write that has to grow the map
+// waits for it and fails with map_full_error after resize_timeout.
+class async_context {
+public:
+    explicit async_context(environment& env, async_options options = {})
+        : env_(env), resume_(std::move(options.resume)),
+          pool_(options.read_threads), writer_(env, options.writer) {}
+
+    async_context(const async_context&) = delete;
+    async_context& operator=(const async_context&) = delete;
+
+    // fn(txn) on an I/O thread, in a read-only transaction.
+    template<typename F>
+    read_awaitable<F> async_read(F fn) {
+        return read_awaitable<F>(*this, std::move(fn));
+    }
+
+    // fn(txn) in a write transaction shared with other writes, committed
+    // before the coroutine resumes. As with async_writer, fn may run more
+    // than once and must only change the database.
+    template<typename F>
+    write_awaitable<F> async_transaction(F fn) {
+        return write_awaitable<F>(*this, std::move(fn));
+    }
+
+    template<typename Container>
+    auto async_get(Container& container, typename Container::key_type key) {
+        return async_read([&container, key = std::move(key)](transaction& txn) {
+            return container.get(txn, key);
+        });
+    }
+
+    template<typename Container>
+    auto async_put(Container& container, typename Container::key_type key,
+                   typename Container::mapped_type value) {
+        return async_transaction([&container, key = std::move(key), value = std::move(value)](transaction& txn) {
+            container.put(txn, key, value);
+        });
+    }
+
+    template<typename Container>
+    auto async_erase(Container& container, typename Container::key_type key) {
+        return async_transaction([&container, key = std::move(key)](transaction& txn) {
+            container.erase(txn, key);
+        });
+    }
+
+private:
+    template<typename F>
+    friend class read_awaitable;
+    template<typename F>
+    friend class write_awaitable;
+
+    environment& env_;
+    std::function<void(std::coroutine_handle<>)> resume_;
+    detail::io_pool pool_;
+    async_writer writer_;
+};
+
+template<typename F>
+void read_awaitable<F>::await_suspend(std::coroutine_handle<> handle) {
+    // Nothing may touch *this after post: the coroutine can resume, and
+    // destroy the awaitable, before post returns.
+    async_context& ctx = ctx_;
+    ctx.pool_.post([this, handle, &ctx] {
+        try {
+            read_txn txn(ctx.env_);
+            outcome_.run(fn_, txn);
+        } catch (...) {
+            outcome_.fail(std::current_exception());
+        }
+        if (ctx.resume_) {
+            ctx.resume_(handle);
+        } else {
+            handle.resume();
+        }
+    });
+}
+
+template<typename F>
+void write_awaitable<F>::await_suspend(std::coroutine_handle<> handle) {
+    async_context& ctx = ctx_;
+    ctx.writer_.post(
+        [this](transaction& txn) { outcome_.run(fn_, txn); },
+        [this, handle, &ctx](std::exception_ptr error) {
+            if (error) outcome_.fail(error);
+            if (ctx.resume_) {
+                ctx.resume_(handle);
+            } else {
+                ctx.pool_.post([handle] { handle.resume(); });
+            }
+        });
+}
+
+}
+
+#endif
@@ -1,46 +1,326 @@
 #pragma once
 #include <lmdb.h>
+#include "error.hpp"
+#include "metrics.hpp"
+#include "reader_pool.hpp"
+#include "resize_gate.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace lmdbmap {
 
+// Settings applied when an environment is opened. Setters return *this so
+// options can be chained:
+//
+//   lmdbmap::environment env("db", lmdbmap::environment_options()
+//       .map_size(size_t(1) << 30).write_map().no_meta_sync());
+class environment_options {
+public:
+    environment_options& map_size(size_t bytes) { map_size_ = bytes; return *this; }
+    environment_options& max_dbs(unsigned int n) { max_dbs_ = n; return *this; }
+    // Upper bound for automatic growth (see grow()); 0 means no limit.
+    environment_options& max_map_size(size_t bytes) { max_map_size_ = bytes; return *this; }
+    // How long growing the map waits for other transactions to end before
+    // it gives up with map_full_error.
+    environment_options& resize_timeout(std::chrono::milliseconds t) { resize_timeout_ = t; return *this; }
+    // Reader lock table slots; 0 keeps LMDB's default (126).
+    environment_options& max_readers(unsigned int n) { max_readers_ = n; return *this; }
+    environment_options& mode(mdb_mode_t m) { mode_ = m; return *this; }
+
+    // Skip the fsync on commit; a crash may lose recent transactions (and
+    // with write_map, corrupt the database) unless sync() is called.
+    environment_options& no_sync(bool on = true) { return flag(MDB_NOSYNC, on); }
+    // Skip the metapage fsync; a crash may lose the last transaction but
+    // keeps the database intact.
+    environment_options& no_meta_sync(bool on = true) { return flag(MDB_NOMETASYNC, on); }
+    // Write through a writable memory map instead of write(2).
+    environment_options& write_map(bool on = true) { return flag(MDB_WRITEMAP, on); }
+    // With write_map, flush asynchronously instead of msync(MS_SYNC).
+    environment_options& map_async(bool on = true) { return flag(MDB_MAPASYNC, on); }
+    // Turn off OS readahead, for databases larger than RAM.
+    environment_options& no_read_ahead(bool on = true) { return flag(MDB_NORDAHEAD, on); }
+    // Tie reader slots to transactions instead of threads; see read_txn.
+    environment_options& no_tls(bool on = true) { return flag(MDB_NOTLS, on); }
+    // Open a database written by lmdbmap 0.4 or earlier, whose keys and
+    // values use the old Boost encodings, without the format check. Only
+    // for migrating it; see "Upgrading" in the README.
+    environment_options& legacy_format(bool on = true) { legacy_format_ = on; return *this; }
+    // Any other mdb_env_open flags.
+    environment_options& flags(unsigned int f) { flags_ = f; return *this; }
+
+    size_t map_size() const { return map_size_; }
+    unsigned int max_dbs() const { return max_dbs_; }
+    size_t max_map_size() const { return max_map_size_; }
+    std::chrono::milliseconds resize_timeout() const { return resize_timeout_; }
+    unsigned int max_readers() const { return max_readers_; }
+    mdb_mode_t mode() const { return mode_; }
+    unsigned int flags() const { return flags_; }
+    bool legacy_format() const { return legacy_format_; }
+
+private:
+    size_t map_size_ = 104857600;
+    unsigned int max_dbs_ = 10;
+    size_t max_map_size_ = 0;
+    std::chrono::milliseconds resize_timeout_{5000};
+    unsigned int max_readers_ = 0;
+    mdb_mode_t mode_ = 0664;
+    unsigned int flags_ = 0;
+    bool legacy_format_ = false;
+
+    environment_options& flag(unsigned int f, bool on) {
+        flags_ = on ? (flags_ | f) : (flags_ & ~f);
+        return *this;
+    }
+};
+
 class environment {
 public:
-    environment(const std::string& path, size_t map_size = 104857600, unsigned int max_dbs = 10) {
+    environment(const std::string& path, size_t map_size = 104857600, unsigned int max_dbs = 10, unsigned int flags = 0)
+        : environment(path, environment_options().map_size(map_size).max_dbs(max_dbs).flags(flags)) {}
+
+    environment(const std::string& path, const environment_options& options)
+        : max_map_size_(options.max_map_size()), resize_timeout_(options.resize_timeout()) {
         int rc = mdb_env_create(&env_);
         if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        mdb_env_set_userctx(env_, this);
 
-        rc = mdb_env_set_mapsize(env_, map_size);
+        rc = mdb_env_set_mapsize(env_, options.map_size());
         if (rc != 0) {
             mdb_env_close(env_);
             throw std::runtime_error(mdb_strerror(rc));
         }
 
-        rc = mdb_env_set_maxdbs(env_, max_dbs);
+        rc = mdb_env_set_maxdbs(env_, options.max_dbs());
         if (rc != 0) {
             mdb_env_close(env_);
             throw std::runtime_error(mdb_strerror(rc));
         }
 
+        if (options.max_readers() != 0) {
+            rc = mdb_env_set_maxreaders(env_, options.max_readers());
+            if (rc != 0) {
+                mdb_env_close(env_);
+                throw std::runtime_error(mdb_strerror(rc));
+            }
+        }
+
         std::filesystem::create_directories(path);
-        rc = mdb_env_open(env_, path.c_str(), 0, 0664);
+        rc = mdb_env_open(env_, path.c_str(), options.flags(), options.mode());
         if (rc != 0) {
             mdb_env_close(env_);
             throw std::runtime_error(mdb_strerror(rc));
         }
+        if (!options.legacy_format()) {
+            try {
+                check_format((options.flags() & MDB_RDONLY) != 0);
+            } catch (...) {
+                mdb_env_close(env_);
+                throw;
+            }
+        }
+        readers_ = std::make_shared<detail::reader_pool>(env_, (options.flags() & MDB_NOTLS) != 0);
     }
 
+    // Version of the key and value encodings, stored under format_key in
+    // the main database when an environment is created. Databases without
+    // it but with data in them were written by lmdbmap 0.4 or earlier,
+    // whose Boost-encoded keys and values would silently decode wrong, and
+    // are refused.
+    static constexpr std::uint32_t format_version = 2;
+    static constexpr const char* format_key = "lmdbmap.format";
+
+    environment(const environment&) = delete;
+    environment& operator=(const environment&) = delete;
+
     ~environment() {
+        if (readers_) readers_->close();
         if (env_) mdb_env_close(env_);
     }
 
     operator MDB_env*() const { return env_; }
 
+    // The environment that opened env, e.g. mdb_txn_env(txn)'s; nullptr if
+    // env was not opened through this class.
+    static environment* of(MDB_env* env) {
+        return env ? static_cast<environment*>(mdb_env_get_userctx(env)) : nullptr;
+    }
+
+    // State that optional components keep per environment, such as the
+    // zstd dictionaries loaded into it: one T, created on first use and
+    // destroyed with the environment. T synchronizes itself.
+    template<typename T>
+    T& attachment() {
+        static const char tag = 0;
+        std::lock_guard<std::mutex> lock(attachments_mutex_);
+        for (const auto& a : attachments_) {
+            if (a.first == &tag) return *static_cast<T*>(a.second.get());
+        }
+        auto created = std::make_shared<T>();
+        attachments_.emplace_back(&tag, created);
+        return *created;
+    }
+
+    // Flushes buffers to disk. Commits already do this unless no_sync or
+    // map_async is set; force also flushes under map_async.
+    void sync(bool force = true) {
+        int rc = mdb_env_sync(env_, force ? 1 : 0);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+    }
+
+    unsigned int flags() const {
+        unsigned int f;
+        int rc = mdb_env_get_flags(env_, &f);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        return f;
+    }
+
+    size_t map_size() const {
+        MDB_envinfo info;
+        int rc = mdb_env_info(env_, &info);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        return info.me_mapsize;
+    }
+
+    // Doubles the map size, up to max_map_size. seen is the size the caller
+    // ran out of; if another thread has grown the map since, this returns
+    // at once. Waits until no transaction of this process is open, and
+    // throws map_full_error when the map cannot grow any further or other
+    // transactions are still open after resize_timeout.
+    void grow(size_t seen) {
+        bool done = gate_.exclusive(resize_timeout_, [&] {
+            size_t current = map_size();
+            if (current > seen) return;
+            size_t target = current * 2;
+            if (max_map_size_ != 0 && target > max_map_size_) target = max_map_size_;
+            if (target <= current) throw map_full_error("lmdbmap: map reached max_map_size");
+            int rc = mdb_env_set_mapsize(env_, target);
+            if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        });
+        if (!done) throw map_full_error("lmdbmap: map is full and other transactions kept it from growing");
+    }
+
+    // Adopts a map size set by another process, after MDB_MAP_RESIZED.
+    void adopt_map_size() {
+        bool done = gate_.exclusive(resize_timeout_, [&] {
+            int rc = mdb_env_set_mapsize(env_, 0);
+            if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        });
+        if (!done) throw map_resized_error(mdb_strerror(MDB_MAP_RESIZED));
+    }
+
+    unsigned int max_readers() const {
+        unsigned int n;
+        int rc = mdb_env_get_maxreaders(env_, &n);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        return n;
+    }
+
+    // Recycled read-only transactions, used by read_txn.
+    detail::reader_pool& readers() { return *readers_; }
+
+    // Held by every open transaction so the map can be resized safely.
+    detail::resize_gate& gate() { return gate_; }
+
+#if LMDBMAP_METRICS
+    environment_metrics& metrics() { return metrics_; }
+
+    // Transaction metrics merged with mdb_env_info and the main database's
+    // mdb_env_stat.
+    environment_metrics_snapshot metrics_snapshot() const {
+        environment_metrics_snapshot s;
+        s.read_txns = metrics_.read_txns.load();
+        s.write_txns = metrics_.write_txns.load();
+        s.commits = metrics_.commits.load();
+        s.aborts = metrics_.aborts.load();
+        s.read_txn_duration = metrics_.read_txn_duration.snapshot();
+        s.write_txn_duration = metrics_.write_txn_duration.snapshot();
+        s.write_wait = metrics_.write_wait.snapshot();
+
+        MDB_envinfo info;
+        int rc = mdb_env_info(env_, &info);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        s.map_size = info.me_mapsize;
+        s.last_pgno = info.me_last_pgno;
+        s.last_txnid = info.me_last_txnid;
+        s.max_readers = info.me_maxreaders;
+        s.num_readers = info.me_numreaders;
+
+        MDB_stat stat;
+        rc = mdb_env_stat(env_, &stat);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        s.page_size = stat.ms_psize;
+        s.depth = stat.ms_depth;
+        s.branch_pages = stat.ms_branch_pages;
+        s.leaf_pages = stat.ms_leaf_pages;
+        s.overflow_pages = stat.ms_overflow_pages;
+        s.entries = stat.ms_entries;
+        return s;
+    }
+#endif
+
 private:
+    // Reads the format marker in a read-only transaction; writes it, in a
+    // write transaction, only when the database is new.
+    void check_format(bool read_only) {
+        MDB_val key{std::strlen(format_key), const_cast<char*>(format_key)};
+        MDB_val data{0, nullptr};
+        MDB_stat stat{};
+        MDB_txn* txn;
+        MDB_dbi main;
+        int rc = mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        rc = mdb_dbi_open(txn, nullptr, 0, &main);
+        if (rc == 0) rc = mdb_get(txn, main, &key, &data);
+        bool found = rc == 0;
+        std::uint32_t stored = 0;
+        if (found && data.mv_size == sizeof(stored)) std::memcpy(&stored, data.mv_data, sizeof(stored));
+        if (rc == MDB_NOTFOUND) rc = mdb_stat(txn, main, &stat);
+        mdb_txn_abort(txn);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+
+        if (found) {
+            if (stored == format_version) return;
+            throw std::runtime_error("lmdbmap: database has format " + std::to_string(stored) +
+                                     ", this version reads format " + std::to_string(format_version));
+        }
+        if (stat.ms_entries != 0) {
+            throw std::runtime_error("lmdbmap: database was written by lmdbmap 0.4 or earlier, "
+                                     "whose encodings differ; open it with legacy_format() to migrate it");
+        }
+        if (read_only) return;
+
+        std::uint32_t version = format_version;
+        data = MDB_val{sizeof(version), &version};
+        rc = mdb_txn_begin(env_, nullptr, 0, &txn);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        rc = mdb_put(txn, main, &key, &data, MDB_NOOVERWRITE);
+        if (rc != 0 && rc != MDB_KEYEXIST) {
+            mdb_txn_abort(txn);
+            throw std::runtime_error(mdb_strerror(rc));
+        }
+        rc = mdb_txn_commit(txn);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+    }
+
     MDB_env* env_ = nullptr;
+    std::shared_ptr<detail::reader_pool> readers_;
+    detail::resize_gate gate_;
+    std::mutex attachments_mutex_;
+    std::vector<std::pair<const void*, std::shared_ptr<void>>> attachments_;
+    size_t max_map_size_ = 0;
+    std::chrono::milliseconds resize_timeout_;
+#if LMDBMAP_METRICS
+    environment_metrics metrics_;
+#endif
 };
 
 }
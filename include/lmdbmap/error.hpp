@@ -0,0 +1,30 @@
+#pragma once
+#include <lmdb.h>
+#include <stdexcept>
+
+namespace lmdbmap {
+
+// The map is full. Thrown by writes and commits; lmdbmap::transact grows
+// the map and retries instead.
+class map_full_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Another process grew the map. Transactions adopt the new size and retry
+// on their own, so this only escapes from raw LMDB calls.
+class map_resized_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+[[noreturn]] inline void throw_error(int rc) {
+    if (rc == MDB_MAP_FULL) throw map_full_error(mdb_strerror(rc));
+    if (rc == MDB_MAP_RESIZED) throw map_resized_error(mdb_strerror(rc));
+    throw std::runtime_error(mdb_strerror(rc));
+}
+
+}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "multimap.hpp"
+#include <lmdb.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace lmdbmap {
+
+// A multimap for fixed-size values such as ids and timestamps, stored with
+// MDB_DUPFIXED so LMDB packs a key's duplicates into contiguous pages.
+// get() and for_each_page() read a page of duplicates per call with
+// MDB_GET_MULTIPLE/MDB_NEXT_MULTIPLE instead of one duplicate per call.
+//
+// Values are stored as their object representation. 4- and 8-byte unsigned
+// integers also use MDB_INTEGERDUP, so their duplicates sort numerically;
+// other types sort by their raw bytes.
+template<typename Key, typename T, typename KeyCodec = key_codec<Key>>
+class fixed_multimap : public multimap<Key, T, KeyCodec, value_codec<T>> {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>,
+                  "fixed_multimap values must be trivially copyable");
+
+    using base = multimap<Key, T, KeyCodec, value_codec<T>>;
+
+public:
+    static constexpr bool integer_dups =
+        std::is_integral_v<T> && std::is_unsigned_v<T> && (sizeof(T) == sizeof(unsigned int) || sizeof(T) == sizeof(size_t));
+
+    fixed_multimap(environment& env, const std::string& name)
+        : base(env, name, MDB_DUPFIXED | (integer_dups ? MDB_INTEGERDUP : 0)) {}
+
+    // All values of key, copied a page at a time into a vector sized with
+    // mdb_cursor_count.
+    std::vector<T> get(transaction& txn, const Key& key) {
+        std::vector<T> results;
+        size_t n = 0;
+        visit_pages(txn, key, [&](size_t count, const MDB_val& page) {
+            size_t items = page.mv_size / sizeof(T);
+            if (results.size() < n + items) results.resize(std::max(count, n + items));
+            std::memcpy(results.data() + n, page.mv_data, items * sizeof(T));
+            n += items;
+        });
+        results.resize(n);
+        return results;
+    }
+
+    // Calls fn(page) for every page of key's values, in order. page is a
+    // byte_view over page.size() / sizeof(T) packed values; it is not
+    // necessarily aligned for T, so read values with memcpy.
+    template<typename F>
+    void for_each_page(transaction& txn, const Key& key, F fn) {
+        visit_pages(txn, key, [&](size_t, const MDB_val& page) { fn(byte_view(page, txn)); });
+    }
+
+private:
+    template<typename F>
+    void visit_pages(transaction& txn, const Key& key, F&& fn) {
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        MDB_val data_val;
+
+        MDB_cursor* cursor = txn.acquire_cursor(this->dbi());
+        try {
+            int rc = mdb_cursor_get(cursor, &key_val, &data_val, MDB_SET);
+            if (rc == 0) {
+                size_t count;
+                rc = mdb_cursor_count(cursor, &count);
+                if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+                rc = mdb_cursor_get(cursor, &key_val, &data_val, MDB_GET_MULTIPLE);
+                while (rc == 0) {
+                    fn(count, data_val);
+                    rc = mdb_cursor_get(cursor, &key_val, &data_val, MDB_NEXT_MULTIPLE);
+                }
+            }
+            if (rc != MDB_NOTFOUND) throw std::runtime_error(mdb_strerror(rc));
+        } catch (...) {
+            txn.release_cursor(cursor);
+            throw;
+        }
+        txn.release_cursor(cursor);
+    }
+};
+
+}
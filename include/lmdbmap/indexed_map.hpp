@@ -0,0 +1,221 @@
+#pragma once
+#include "environment.hpp"
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include "map.hpp"
+#include "multimap.hpp"
+#include <lmdb.h>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+
+// An index on whatever Extract returns for a value: a pointer to a data
+// member or a member function, or a free function.
+//
+//   lmdbmap::indexed_map<int, user, lmdbmap::index_by<&user::email>> users(env, "users");
+//
+// Any type with a static extract(const T&) works as an index too. It may
+// also define static constexpr const char* name, used to name its database.
+template<auto Extract>
+struct index_by {
+    template<typename T>
+    static auto extract(const T& value) { return std::invoke(Extract, value); }
+};
+
+namespace detail {
+
+template<typename Index, typename = void>
+struct has_index_name : std::false_type {};
+
+template<typename Index>
+struct has_index_name<Index, std::void_t<decltype(Index::name)>> : std::true_type {};
+
+template<typename Index>
+std::string index_dbi_name(const std::string& name, size_t position) {
+    if constexpr (has_index_name<Index>::value) {
+        return name + "." + Index::name;
+    } else {
+        return name + "." + std::to_string(position);
+    }
+}
+
+template<typename Index, typename... Indexes>
+constexpr size_t index_position() {
+    constexpr bool matches[] = {std::is_same_v<Index, Indexes>...};
+    for (size_t i = 0; i < sizeof...(Indexes); ++i) {
+        if (matches[i]) return i;
+    }
+    return sizeof...(Indexes);
+}
+
+}
+
+// A map that keeps one secondary index per Indexes entry. Each index is a
+// MDB_DUPSORT database from the extracted attribute to the primary keys of
+// the values that have it, updated in the same write transaction by put,
+// insert and erase, so find_by is a single seek instead of a scan.
+//
+// An index database is named after the map plus the index's name, or its
+// position when it has none; reordering unnamed indexes requires
+// rebuild_indexes(). Primary keys are stored as index values and so must
+// encode to at most mdb_env_get_maxkeysize() bytes.
+template<typename Key, typename T, typename... Indexes>
+class indexed_map {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<Key, T>;
+    using primary_type = map<Key, T>;
+    using key_codec_type = typename primary_type::key_codec_type;
+    using value_codec_type = typename primary_type::value_codec_type;
+
+    template<typename Index>
+    using index_key_type = std::decay_t<decltype(Index::extract(std::declval<const T&>()))>;
+
+    template<typename Index>
+    using index_type = multimap<index_key_type<Index>, Key, key_codec<index_key_type<Index>>, key_codec_type>;
+
+    indexed_map(environment& env, const std::string& name)
+        : indexed_map(env, name, std::index_sequence_for<Indexes...>()) {}
+
+    std::optional<T> get(transaction& txn, const Key& key) {
+        return primary_.get(txn, key);
+    }
+
+    // Insert or assign. The old value, if any, is read once to remove the
+    // index entries that no longer apply.
+    void put(transaction& txn, const Key& key, const T& value) {
+        std::optional<T> old = primary_.get(txn, key);
+        primary_.put(txn, key, value);
+        for_each_index([&](auto& index, auto tag) {
+            using Index = typename decltype(tag)::type;
+            auto attribute = Index::extract(value);
+            if (old) {
+                auto old_attribute = Index::extract(*old);
+                if (same_encoding<Index>(old_attribute, attribute)) return;
+                index.erase(txn, old_attribute, key);
+            }
+            index.insert(txn, attribute, key);
+        });
+    }
+
+    // Insert only if not exists
+    bool insert(transaction& txn, const Key& key, const T& value) {
+        if (!primary_.insert(txn, key, value)) return false;
+        for_each_index([&](auto& index, auto tag) {
+            using Index = typename decltype(tag)::type;
+            index.insert(txn, Index::extract(value), key);
+        });
+        return true;
+    }
+
+    bool erase(transaction& txn, const Key& key) {
+        std::optional<T> old = primary_.get(txn, key);
+        if (!old) return false;
+        primary_.erase(txn, key);
+        for_each_index([&](auto& index, auto tag) {
+            using Index = typename decltype(tag)::type;
+            index.erase(txn, Index::extract(*old), key);
+        });
+        return true;
+    }
+
+    // Entries whose Index attribute equals attribute, in primary key order.
+    template<typename Index>
+    std::vector<value_type> find_by(transaction& txn, const index_key_type<Index>& attribute) {
+        std::vector<Key> keys = keys_by<Index>(txn, attribute);
+        std::vector<std::optional<T>> values = primary_.get_many(txn, keys);
+        std::vector<value_type> out;
+        out.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (!values[i]) throw std::runtime_error("lmdbmap: index entry without a value");
+            out.emplace_back(std::move(keys[i]), std::move(*values[i]));
+        }
+        return out;
+    }
+
+    // Primary keys of the entries whose Index attribute equals attribute,
+    // without reading the values.
+    template<typename Index>
+    std::vector<Key> keys_by(transaction& txn, const index_key_type<Index>& attribute) {
+        return index<Index>().get(txn, attribute);
+    }
+
+    template<typename Index>
+    size_t count_by(transaction& txn, const index_key_type<Index>& attribute) {
+        return index<Index>().count(txn, attribute);
+    }
+
+    // Empties every index and fills it again from the stored values, e.g.
+    // after adding an index to a map that already has data.
+    void rebuild_indexes(transaction& txn) {
+        for_each_index([&](auto& index, auto) {
+            int rc = mdb_drop(txn, index.dbi(), 0);
+            if (rc != 0) detail::throw_error(rc);
+        });
+        for (auto it = primary_.begin(txn); it != primary_.end(txn); ++it) {
+            const value_type& entry = *it;
+            for_each_index([&](auto& index, auto tag) {
+                using Index = typename decltype(tag)::type;
+                index.insert(txn, Index::extract(entry.second), entry.first);
+            });
+        }
+    }
+
+    size_t size(transaction& txn) { return primary_.size(txn); }
+    bool empty(transaction& txn) { return primary_.empty(txn); }
+
+    // For ranges and scans over the primary map. Writing through it skips
+    // the indexes.
+    primary_type& primary() { return primary_; }
+
+    template<typename Index>
+    index_type<Index>& index() {
+        constexpr size_t position = detail::index_position<Index, Indexes...>();
+        static_assert(position < sizeof...(Indexes), "lmdbmap: not an index of this map");
+        return std::get<position>(indexes_);
+    }
+
+private:
+    template<typename Index>
+    struct index_tag {
+        using type = Index;
+    };
+
+    primary_type primary_;
+    std::tuple<index_type<Indexes>...> indexes_;
+
+    template<size_t... Is>
+    indexed_map(environment& env, const std::string& name, std::index_sequence<Is...>)
+        : primary_(env, name),
+          indexes_(index_type<Indexes>(env, detail::index_dbi_name<Indexes>(name, Is))...) {}
+
+    // Calls fn(index, index_tag<Index>{}) for every index.
+    template<typename F>
+    void for_each_index(F&& fn) {
+        for_each_index(fn, std::index_sequence_for<Indexes...>());
+    }
+
+    template<typename F, size_t... Is>
+    void for_each_index(F& fn, std::index_sequence<Is...>) {
+        (fn(std::get<Is>(indexes_), index_tag<Indexes>{}), ...);
+    }
+
+    template<typename Index>
+    static bool same_encoding(const index_key_type<Index>& a, const index_key_type<Index>& b) {
+        using codec = key_codec<index_key_type<Index>>;
+        auto x = codec::encode(a);
+        auto y = codec::encode(b);
+        return equal_bytes(to_mdb_val(x), to_mdb_val(y));
+    }
+};
+
+}
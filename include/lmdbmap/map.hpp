@@ -2,27 +2,42 @@
 #include "environment.hpp"
 #include "transaction.hpp"
 #include "serialization.hpp"
+#include "view.hpp"
+#include "projection.hpp"
+#include "range.hpp"
+#include "metrics.hpp"
 #include <lmdb.h>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <iterator>
 #include <vector>
 #include <cstring>
+#include <algorithm>
+#include <memory>
+#include <utility>
 
 namespace lmdbmap {
 
-template<typename Key, typename T>
+template<typename Key, typename T, typename KeyCodec = key_codec<Key>, typename ValueCodec = value_codec<T>>
 class map {
 public:
     using key_type = Key;
     using mapped_type = T;
     using value_type = std::pair<Key, T>;
+    using key_codec_type = KeyCodec;
+    using value_codec_type = ValueCodec;
 
+    // In an environment opened with MDB_RDONLY the database must exist.
     map(environment& env, const std::string& name) : env_(env) {
-        transaction txn(env);
-        int rc = mdb_dbi_open(txn, name.c_str(), MDB_CREATE, &dbi_);
+        bool read_only = (env.flags() & MDB_RDONLY) != 0;
+        transaction txn(env, read_only);
+        int rc = mdb_dbi_open(txn, name.c_str(), read_only ? 0 : MDB_CREATE, &dbi_);
         if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
         txn.commit();
+#if LMDBMAP_METRICS
+        metrics_ = std::make_shared<map_metrics>(name);
+#endif
     }
 
     ~map() {
@@ -31,251 +46,480 @@ public:
 
     // Insert only if not exists
     bool insert(transaction& txn, const Key& key, const T& value) {
-        std::string k = serialize(key);
-        std::string v = serialize(value);
-        MDB_val key_val{k.size(), k.data()};
-        MDB_val data_val{v.size(), v.data()};
-        int rc = mdb_put(txn, dbi_, &key_val, &data_val, MDB_NOOVERWRITE);
-        if (rc == MDB_KEYEXIST) return false;
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        auto p = probe();
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        p.encoded(key_val.mv_size);
+        int rc = detail::put_value<ValueCodec>(txn, dbi_, &key_val, value, MDB_NOOVERWRITE, p);
+        if (rc == MDB_KEYEXIST) {
+            p.existing_insert();
+            return false;
+        }
+        p.put();
+        if (rc != 0) detail::throw_error(rc);
         return true;
     }
 
     // Insert or assign (overwrite)
     void put(transaction& txn, const Key& key, const T& value) {
-        std::string k = serialize(key);
-        std::string v = serialize(value);
-        MDB_val key_val{k.size(), k.data()};
-        MDB_val data_val{v.size(), v.data()};
-        int rc = mdb_put(txn, dbi_, &key_val, &data_val, 0);
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        auto p = probe();
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        p.encoded(key_val.mv_size);
+        int rc = detail::put_value<ValueCodec>(txn, dbi_, &key_val, value, 0, p);
+        p.put();
+        if (rc != 0) detail::throw_error(rc);
     }
 
     std::optional<T> get(transaction& txn, const Key& key) {
-        std::string k = serialize(key);
-        MDB_val key_val{k.size(), k.data()};
+        auto p = probe();
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        p.encoded(key_val.mv_size);
         MDB_val data_val;
         int rc = mdb_get(txn, dbi_, &key_val, &data_val);
-        if (rc == MDB_NOTFOUND) return std::nullopt;
+        p.lmdb();
+        if (rc == MDB_NOTFOUND) {
+            p.get(false);
+            return std::nullopt;
+        }
         if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
-        return deserialize<T>(data_val);
+        std::optional<T> value = ValueCodec::decode(data_val.mv_data, data_val.mv_size);
+        p.decoded(data_val.mv_size);
+        p.get(true);
+        return value;
+    }
+
+    // Looks up all keys with one cursor and returns the results in input
+    // order. Keys are visited in encoded order so neighbouring keys are found
+    // on the same leaf page, and a key stored right after the previous one is
+    // reached with MDB_NEXT instead of a new seek.
+    std::vector<std::optional<T>> get_many(transaction& txn, const std::vector<Key>& keys) {
+        using encoded_key = decltype(KeyCodec::encode(std::declval<const Key&>()));
+        auto p = probe();
+        std::vector<encoded_key> encoded;
+        std::vector<MDB_val> key_vals;
+        encoded.reserve(keys.size());
+        key_vals.reserve(keys.size());
+        size_t key_bytes = 0;
+        for (const Key& key : keys) {
+            encoded.push_back(KeyCodec::encode(key));
+            key_vals.push_back(to_mdb_val(encoded.back()));
+            key_bytes += key_vals.back().mv_size;
+        }
+        std::vector<size_t> order(keys.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return compare_bytes(key_vals[a], key_vals[b]) < 0;
+        });
+
+        p.encoded(key_bytes);
+
+        std::vector<std::optional<T>> results(keys.size());
+        size_t found = 0;
+        MDB_cursor* cursor = txn.acquire_cursor(dbi_);
+        try {
+            MDB_val k, v;
+            bool positioned = false;
+            for (size_t i : order) {
+                const MDB_val& want = key_vals[i];
+                int c = positioned ? compare_bytes(k, want) : -1;
+                if (c < 0 && positioned) {
+                    int rc = mdb_cursor_get(cursor, &k, &v, MDB_NEXT);
+                    if (rc == MDB_NOTFOUND) break;
+                    if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+                    c = compare_bytes(k, want);
+                }
+                if (c < 0) {
+                    k = want;
+                    int rc = mdb_cursor_get(cursor, &k, &v, MDB_SET_RANGE);
+                    if (rc == MDB_NOTFOUND) break;
+                    if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+                    positioned = true;
+                    c = compare_bytes(k, want);
+                }
+                if (c == 0) {
+                    p.lmdb();
+                    results[i] = ValueCodec::decode(v.mv_data, v.mv_size);
+                    p.decoded(v.mv_size);
+                    ++found;
+                }
+            }
+            p.lmdb();
+        } catch (...) {
+            txn.release_cursor(cursor);
+            throw;
+        }
+        txn.release_cursor(cursor);
+        p.get_many(keys.size(), found);
+        return results;
+    }
+
+    // Stored bytes of the value for key, without decoding. See byte_view for
+    // how long the view stays valid.
+    std::optional<byte_view> get_view(transaction& txn, const Key& key) {
+        auto p = probe();
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        p.encoded(key_val.mv_size);
+        MDB_val data_val;
+        int rc = mdb_get(txn, dbi_, &key_val, &data_val);
+        p.lmdb();
+        if (rc == MDB_NOTFOUND) {
+            p.get(false);
+            return std::nullopt;
+        }
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        p.get(true);
+        return byte_view(data_val, txn);
     }
 
     void erase(transaction& txn, const Key& key) {
-        std::string k = serialize(key);
-        MDB_val key_val{k.size(), k.data()};
+        auto p = probe();
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        p.encoded(key_val.mv_size);
         int rc = mdb_del(txn, dbi_, &key_val, nullptr);
-        if (rc != 0 && rc != MDB_NOTFOUND) throw std::runtime_error(mdb_strerror(rc));
+        p.lmdb();
+        p.erase();
+        if (rc != 0 && rc != MDB_NOTFOUND) detail::throw_error(rc);
+    }
+
+    MDB_dbi dbi() const { return dbi_; }
+
+#if LMDBMAP_METRICS
+    // This map's counters merged with its mdb_stat as seen by txn.
+    map_metrics_snapshot metrics(transaction& txn) const {
+        return detail::snapshot(*metrics_, txn, dbi_);
     }
+#endif
 
     bool empty(transaction& txn) {
+        return size(txn) == 0;
+    }
+
+    // Number of entries, from mdb_stat without touching any entry.
+    size_t size(transaction& txn) {
         MDB_stat stat;
         int rc = mdb_stat(txn, dbi_, &stat);
         if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
-        return stat.ms_entries == 0;
+        return stat.ms_entries;
     }
 
+    size_t count(transaction& txn, const Key& key) {
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        MDB_val data_val;
+        int rc = mdb_get(txn, dbi_, &key_val, &data_val);
+        if (rc == MDB_NOTFOUND) return 0;
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        return 1;
+    }
+
+    // Number of keys in [lo, hi). Walks the range with one cursor but
+    // decodes nothing.
+    size_t count_range(transaction& txn, const Key& lo, const Key& hi) {
+        auto lo_bytes = KeyCodec::encode(lo);
+        auto hi_bytes = KeyCodec::encode(hi);
+        MDB_val k = to_mdb_val(lo_bytes);
+        MDB_val end = to_mdb_val(hi_bytes);
+        MDB_val v;
+        size_t n = 0;
+
+        MDB_cursor* cursor = txn.acquire_cursor(dbi_);
+        int rc = mdb_cursor_get(cursor, &k, &v, MDB_SET_RANGE);
+        while (rc == 0 && compare_bytes(k, end) < 0) {
+            ++n;
+            rc = mdb_cursor_get(cursor, &k, &v, MDB_NEXT);
+        }
+        txn.release_cursor(cursor);
+        if (rc != 0 && rc != MDB_NOTFOUND) throw std::runtime_error(mdb_strerror(rc));
+        return n;
+    }
+
+    // Iterators must not outlive their transaction. A copy shares the
+    // source's position but only takes a cursor from the transaction's pool
+    // once it is moved. In a write transaction, where a later put or erase
+    // may move or free the page an entry is on, a copy keeps its own copy of
+    // the key and finds the entry again when it is used; that throws if
+    // the entry was erased meanwhile. end() sits between the last entry and
+    // the first, so --end() is the last entry and ++end() the first.
     class iterator {
     public:
-        using iterator_category = std::forward_iterator_tag;
+        using iterator_category = std::bidirectional_iterator_tag;
         using value_type = std::pair<Key, T>;
         using difference_type = std::ptrdiff_t;
         using pointer = value_type*;
         using reference = value_type&;
 
-        iterator() : cursor_(nullptr), is_end_(true) {}
-        
-        iterator(MDB_cursor* cursor, bool end = false) : cursor_(cursor), is_end_(end) {
-            if (!is_end_ && cursor_) {
-                update_current();
-            }
-        }
+        iterator() = default;
+
+        iterator(transaction* txn, MDB_dbi dbi, MDB_cursor* cursor, const MDB_val& k, const MDB_val& v)
+            : txn_(txn), dbi_(dbi), cursor_(cursor), k_(k), v_(v), is_end_(false) {}
+
+        // The end position of txn.
+        iterator(transaction* txn, MDB_dbi dbi) : txn_(txn), dbi_(dbi) {}
 
         ~iterator() {
-            if (cursor_) mdb_cursor_close(cursor_);
+            release();
         }
 
         iterator(const iterator& other) {
             copy_from(other);
         }
 
+        iterator(iterator&& other) noexcept {
+            move_from(other);
+        }
+
         iterator& operator=(const iterator& other) {
             if (this != &other) {
-                if (cursor_) mdb_cursor_close(cursor_);
+                release();
                 copy_from(other);
             }
             return *this;
         }
 
-        iterator& operator++() {
-            if (is_end_ || !cursor_) return *this;
-            MDB_val k, v;
-            int rc = mdb_cursor_get(cursor_, &k, &v, MDB_NEXT);
-            if (rc == MDB_NOTFOUND) {
-                is_end_ = true;
-            } else if (rc != 0) {
-                throw std::runtime_error(mdb_strerror(rc));
-            } else {
-                update_current();
+        iterator& operator=(iterator&& other) noexcept {
+            if (this != &other) {
+                release();
+                move_from(other);
             }
             return *this;
         }
 
+        iterator& operator++() {
+            return is_end_ ? wrap(MDB_FIRST) : step(MDB_NEXT);
+        }
+
         iterator operator++(int) {
             iterator tmp = *this;
             ++(*this);
             return tmp;
         }
 
+        iterator& operator--() {
+            return is_end_ ? wrap(MDB_LAST) : step(MDB_PREV);
+        }
+
+        iterator operator--(int) {
+            iterator tmp = *this;
+            --(*this);
+            return tmp;
+        }
+
         bool operator==(const iterator& other) const {
             if (is_end_ && other.is_end_) return true;
             if (is_end_ || other.is_end_) return false;
-            return current_.first == other.current_.first; 
+            return equal_bytes(k_, other.k_);
         }
 
         bool operator!=(const iterator& other) const {
             return !(*this == other);
         }
 
-        reference operator*() { return current_; }
-        pointer operator->() { return &current_; }
+        reference operator*() {
+            key();
+            value();
+            return current_;
+        }
+        pointer operator->() { return &**this; }
+
+        // Decode only one half of the current entry. Each half is decoded at
+        // most once per position.
+        const Key& key() const {
+            if (!has_key_) {
+                check_not_end();
+                current_.first = KeyCodec::decode(k_.mv_data, k_.mv_size);
+                has_key_ = true;
+            }
+            return current_.first;
+        }
+
+        const T& value() const {
+            if (!has_value_) {
+                check_not_end();
+                attach();
+                current_.second = ValueCodec::decode(v_.mv_data, v_.mv_size);
+                has_value_ = true;
+            }
+            return current_.second;
+        }
+
+        // Undecoded bytes of the current entry, see byte_view.
+        byte_view key_view() const {
+            check_not_end();
+            attach();
+            return byte_view(k_, *txn_);
+        }
+
+        byte_view value_view() const {
+            check_not_end();
+            attach();
+            return byte_view(v_, *txn_);
+        }
 
     private:
-        MDB_cursor* cursor_ = nullptr;
+        transaction* txn_ = nullptr;
+        MDB_dbi dbi_ = 0;
+        mutable MDB_cursor* cursor_ = nullptr;
+        mutable MDB_val k_{0, nullptr};
+        mutable MDB_val v_{0, nullptr};
         bool is_end_ = true;
-        value_type current_;
+        mutable value_type current_;
+        mutable bool has_key_ = false;
+        mutable bool has_value_ = false;
+        // Set while k_ points into owned_ instead of into the map.
+        mutable bool detached_ = false;
+        std::string owned_;
 
         void copy_from(const iterator& other) {
+            txn_ = other.txn_;
+            dbi_ = other.dbi_;
+            cursor_ = nullptr;
+            k_ = other.k_;
+            v_ = other.v_;
             is_end_ = other.is_end_;
-            if (other.cursor_) {
-                int rc = mdb_cursor_open(mdb_cursor_txn(other.cursor_), mdb_cursor_dbi(other.cursor_), &cursor_);
-                if (rc != 0) throw std::runtime_error("Failed to duplicate cursor");
-                if (!is_end_) {
-                    MDB_val k, v;
-                    rc = mdb_cursor_get(other.cursor_, &k, &v, MDB_GET_CURRENT);
-                    if (rc == 0) {
-                        mdb_cursor_get(cursor_, &k, &v, MDB_SET);
-                        update_current();
-                    } else {
-                        // If we can't get current, maybe it's invalid or end?
-                        is_end_ = true;
-                    }
-                }
-            } else {
-                cursor_ = nullptr;
+            current_ = other.current_;
+            has_key_ = other.has_key_;
+            has_value_ = other.has_value_;
+            detached_ = false;
+            if (!is_end_ && !txn_->read_only()) detach();
+        }
+
+        void move_from(iterator& other) {
+            txn_ = other.txn_;
+            dbi_ = other.dbi_;
+            cursor_ = other.cursor_;
+            k_ = other.k_;
+            v_ = other.v_;
+            is_end_ = other.is_end_;
+            current_ = std::move(other.current_);
+            has_key_ = other.has_key_;
+            has_value_ = other.has_value_;
+            detached_ = other.detached_;
+            if (detached_) {
+                owned_ = std::move(other.owned_);
+                point_into_owned();
             }
+            other.cursor_ = nullptr;
+            other.is_end_ = true;
         }
 
-        void update_current() {
-            MDB_val k, v;
-            int rc = mdb_cursor_get(cursor_, &k, &v, MDB_GET_CURRENT);
-            if (rc == 0) {
-                current_.first = deserialize<Key>(k);
-                current_.second = deserialize<T>(v);
+        void detach() {
+            owned_.assign(static_cast<const char*>(k_.mv_data), k_.mv_size);
+            detached_ = true;
+            point_into_owned();
+        }
+
+        void point_into_owned() {
+            k_ = MDB_val{owned_.size(), &owned_[0]};
+            v_ = MDB_val{0, nullptr};
+        }
+
+        // Finds a detached position in the map again.
+        void attach() const {
+            if (!detached_) return;
+            ensure_cursor();
+            int rc = mdb_cursor_get(cursor_, &k_, &v_, MDB_GET_CURRENT);
+            if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+            detached_ = false;
+        }
+
+        void release() {
+            if (cursor_) txn_->release_cursor(cursor_);
+            cursor_ = nullptr;
+        }
+
+        iterator& step(MDB_cursor_op op) {
+            ensure_cursor();
+            return advance(op);
+        }
+
+        // Leaves the end position for the first or last entry.
+        iterator& wrap(MDB_cursor_op op) {
+            if (!txn_) return *this;
+            if (!cursor_) cursor_ = txn_->acquire_cursor(dbi_);
+            is_end_ = false;
+            return advance(op);
+        }
+
+        iterator& advance(MDB_cursor_op op) {
+            detached_ = false;
+            int rc = mdb_cursor_get(cursor_, &k_, &v_, op);
+            if (rc == MDB_NOTFOUND) {
+                is_end_ = true;
+                release();
+            } else if (rc != 0) {
+                throw std::runtime_error(mdb_strerror(rc));
+            } else {
+                has_key_ = has_value_ = false;
             }
+            return *this;
         }
-    };
 
-    iterator begin(transaction& txn) {
-        MDB_cursor* cursor;
-        int rc = mdb_cursor_open(txn, dbi_, &cursor);
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
-        
-        MDB_val k, v;
-        rc = mdb_cursor_get(cursor, &k, &v, MDB_FIRST);
-        if (rc == MDB_NOTFOUND) {
-            mdb_cursor_close(cursor);
-            return end(txn);
+        void ensure_cursor() const {
+            if (cursor_) return;
+            cursor_ = txn_->acquire_cursor(dbi_);
+            MDB_val k = k_, v;
+            int rc = mdb_cursor_get(cursor_, &k, &v, MDB_SET);
+            if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
         }
-        if (rc != 0) {
-            mdb_cursor_close(cursor);
-            throw std::runtime_error(mdb_strerror(rc));
+
+        void check_not_end() const {
+            if (is_end_) throw std::out_of_range("lmdbmap: dereferencing end iterator");
         }
-        return iterator(cursor, false);
+    };
+
+    iterator begin(transaction& txn) {
+        MDB_val k{0, nullptr};
+        return position(txn, k, MDB_FIRST);
     }
 
     iterator end(transaction& txn) {
-        return iterator(nullptr, true);
+        return iterator(&txn, dbi_);
     }
 
-    iterator find(transaction& txn, const Key& key) {
-        MDB_cursor* cursor;
-        int rc = mdb_cursor_open(txn, dbi_, &cursor);
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+    reverse_iterator<iterator> rbegin(transaction& txn) {
+        MDB_val k{0, nullptr};
+        return reverse_iterator<iterator>(position(txn, k, MDB_LAST));
+    }
 
-        std::string k = serialize(key);
-        MDB_val key_val{k.size(), k.data()};
-        MDB_val data_val;
-        
-        rc = mdb_cursor_get(cursor, &key_val, &data_val, MDB_SET);
-        if (rc == MDB_NOTFOUND) {
-            mdb_cursor_close(cursor);
-            return end(txn);
-        }
-        if (rc != 0) {
-            mdb_cursor_close(cursor);
-            throw std::runtime_error(mdb_strerror(rc));
-        }
-        return iterator(cursor, false);
+    reverse_iterator<iterator> rend(transaction& txn) {
+        return reverse_iterator<iterator>(end(txn));
+    }
+
+    iterator find(transaction& txn, const Key& key) {
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        return position(txn, key_val, MDB_SET_KEY);
     }
 
     iterator lower_bound(transaction& txn, const Key& key) {
-        MDB_cursor* cursor;
-        int rc = mdb_cursor_open(txn, dbi_, &cursor);
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        auto k = KeyCodec::encode(key);
+        return lower_bound_encoded(txn, std::string_view(k.data(), k.size()));
+    }
 
-        std::string k = serialize(key);
-        MDB_val key_val{k.size(), k.data()};
-        MDB_val data_val;
-        
-        rc = mdb_cursor_get(cursor, &key_val, &data_val, MDB_SET_RANGE);
-        if (rc == MDB_NOTFOUND) {
-            mdb_cursor_close(cursor);
-            return end(txn);
-        }
-        if (rc != 0) {
-            mdb_cursor_close(cursor);
-            throw std::runtime_error(mdb_strerror(rc));
-        }
-        return iterator(cursor, false);
+    // lower_bound for a key that is already encoded, or a prefix of one.
+    iterator lower_bound_encoded(transaction& txn, std::string_view key) {
+        MDB_val key_val{key.size(), const_cast<char*>(key.data())};
+        return position(txn, key_val, MDB_SET_RANGE);
     }
 
     iterator upper_bound(transaction& txn, const Key& key) {
-        MDB_cursor* cursor;
-        int rc = mdb_cursor_open(txn, dbi_, &cursor);
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
-
-        std::string k = serialize(key);
-        MDB_val key_val{k.size(), k.data()};
-        MDB_val data_val;
-        
-        rc = mdb_cursor_get(cursor, &key_val, &data_val, MDB_SET_RANGE);
-        if (rc == MDB_NOTFOUND) {
-            mdb_cursor_close(cursor);
-            return end(txn);
-        }
-        if (rc != 0) {
-            mdb_cursor_close(cursor);
-            throw std::runtime_error(mdb_strerror(rc));
-        }
-
-        if (key_val.mv_size == k.size() && std::memcmp(key_val.mv_data, k.data(), k.size()) == 0) {
-            rc = mdb_cursor_get(cursor, &key_val, &data_val, MDB_NEXT);
-            if (rc == MDB_NOTFOUND) {
-                mdb_cursor_close(cursor);
-                return end(txn);
-            }
-            if (rc != 0) {
-                mdb_cursor_close(cursor);
-                throw std::runtime_error(mdb_strerror(rc));
-            }
-        }
-        
-        return iterator(cursor, false);
+        return equal_range(txn, key).second;
     }
 
+    // Both bounds come from a single cursor: it is positioned at the lower
+    // bound, a cursorless copy keeps that position, and the cursor itself is
+    // stepped past key.
     std::pair<iterator, iterator> equal_range(transaction& txn, const Key& key) {
-        return {lower_bound(txn, key), upper_bound(txn, key)};
+        auto k = KeyCodec::encode(key);
+        MDB_val key_val = to_mdb_val(k);
+        iterator last = position(txn, key_val, MDB_SET_RANGE);
+        iterator first = last;
+        if (last != end(txn) && equal_bytes(key_val, to_mdb_val(k))) ++last;
+        return {std::move(first), std::move(last)};
     }
 
     struct range_proxy {
@@ -290,9 +534,58 @@ public:
         return {*this, txn};
     }
 
+    // Entries with keys from lo to hi; by default lo is included and hi is not.
+    bounded_range<map> range(transaction& txn, const Key& lo, const Key& hi,
+                             bool include_lo = true, bool include_hi = false) {
+        return bounded_range<map>(*this, txn, lo, hi, include_lo, include_hi);
+    }
+
+    // Entries whose key starts with the given leading components of a
+    // composite key, e.g. prefix_range(txn, tenant) or prefix_range(txn,
+    // tenant, user) for std::tuple<tenant, user, ts> keys: one seek, then a
+    // contiguous scan.
+    template<typename... Parts>
+    prefixed_range<map> prefix_range(transaction& txn, const Parts&... parts) {
+        return prefixed_range<map>(*this, txn, KeyCodec::encode_prefix(parts...));
+    }
+
+    // Scans that decode only keys or only values.
+    projection_range<map, true> keys(transaction& txn) {
+        return {*this, txn};
+    }
+
+    projection_range<map, false> values(transaction& txn) {
+        return {*this, txn};
+    }
+
 private:
     environment& env_;
     MDB_dbi dbi_;
+#if LMDBMAP_METRICS
+    std::shared_ptr<map_metrics> metrics_;
+#endif
+
+    detail::op_probe probe() const {
+#if LMDBMAP_METRICS
+        return detail::op_probe(*metrics_);
+#else
+        return {};
+#endif
+    }
+
+    // Seeks a pooled cursor with op; on success k holds the key found.
+    iterator position(transaction& txn, MDB_val& k, MDB_cursor_op op) {
+        probe().scan();
+        MDB_cursor* cursor = txn.acquire_cursor(dbi_);
+        MDB_val v;
+        int rc = mdb_cursor_get(cursor, &k, &v, op);
+        if (rc != 0) {
+            txn.release_cursor(cursor);
+            if (rc == MDB_NOTFOUND) return end(txn);
+            throw std::runtime_error(mdb_strerror(rc));
+        }
+        return iterator(&txn, dbi_, cursor, k, v);
+    }
 };
 
 }
@@ -0,0 +1,306 @@
+#pragma once
+#include <lmdb.h>
+#include <cstddef>
+#include <cstdint>
+
+// Operation counters and latency histograms for maps, multimaps and
+// transactions. Off by default; with LMDBMAP_METRICS=0 every hook is an
+// empty inline function and none of the types below exist. Define it the
+// same way in every translation unit (the CMake option does).
+#ifndef LMDBMAP_METRICS
+#define LMDBMAP_METRICS 0
+#endif
+
+#if LMDBMAP_METRICS
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#endif
+
+namespace lmdbmap {
+
+#if LMDBMAP_METRICS
+
+namespace detail {
+
+// Threads update one of metric_stripes copies of every counter and
+// histogram, picked once per thread, so the hot path is a relaxed add to a
+// cache line other threads rarely touch. Snapshots sum the stripes.
+constexpr size_t metric_stripes = 8;
+
+inline size_t metric_stripe() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % metric_stripes;
+    return stripe;
+}
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned highest_bit(uint64_t v) {
+    return 63 - static_cast<unsigned>(__builtin_clzll(v | 1));
+}
+
+}
+
+class counter {
+public:
+    void add(uint64_t n) {
+        stripes_[detail::metric_stripe()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t load() const {
+        uint64_t sum = 0;
+        for (const auto& s : stripes_) sum += s.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    struct alignas(64) stripe {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<stripe, detail::metric_stripes> stripes_;
+};
+
+// Merged contents of a histogram. Values are nanoseconds.
+struct histogram_snapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::vector<uint64_t> buckets;
+
+    double mean() const { return count ? static_cast<double>(sum) / count : 0; }
+
+    // Upper bound of the bucket holding the p-th quantile, p in [0, 1];
+    // within 1/16 of the recorded value.
+    uint64_t percentile(double p) const;
+};
+
+// Log-linear buckets in the manner of HdrHistogram: values below 32 get a
+// bucket each, above that every power of two is split into 16 buckets, so
+// the relative error stays under 6.25% from nanoseconds to hours.
+class histogram {
+public:
+    static constexpr unsigned sub_bits = 4;
+    static constexpr size_t bucket_count = (64 - sub_bits + 1) << sub_bits;
+
+    static size_t bucket_of(uint64_t v) {
+        unsigned msb = detail::highest_bit(v);
+        if (msb <= sub_bits) return static_cast<size_t>(v);
+        unsigned shift = msb - sub_bits;
+        return ((shift + 1) << sub_bits) + ((v >> shift) & ((1u << sub_bits) - 1));
+    }
+
+    // Smallest value that falls into bucket b.
+    static uint64_t bucket_floor(size_t b) {
+        if (b < (size_t(2) << sub_bits)) return b;
+        unsigned shift = static_cast<unsigned>(b >> sub_bits) - 1;
+        return ((uint64_t(1) << sub_bits) + (b & ((1u << sub_bits) - 1))) << shift;
+    }
+
+    void record(uint64_t v) {
+        stripe& s = stripes_[detail::metric_stripe()];
+        s.buckets[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+        s.count.fetch_add(1, std::memory_order_relaxed);
+        s.sum.fetch_add(v, std::memory_order_relaxed);
+        uint64_t max = s.max.load(std::memory_order_relaxed);
+        while (v > max && !s.max.compare_exchange_weak(max, v, std::memory_order_relaxed)) {}
+    }
+
+    histogram_snapshot snapshot() const {
+        histogram_snapshot out;
+        out.buckets.assign(bucket_count, 0);
+        for (const stripe& s : stripes_) {
+            for (size_t b = 0; b < bucket_count; ++b) out.buckets[b] += s.buckets[b].load(std::memory_order_relaxed);
+            out.count += s.count.load(std::memory_order_relaxed);
+            out.sum += s.sum.load(std::memory_order_relaxed);
+            uint64_t max = s.max.load(std::memory_order_relaxed);
+            if (max > out.max) out.max = max;
+        }
+        return out;
+    }
+
+private:
+    struct alignas(64) stripe {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+        std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    };
+    std::array<stripe, detail::metric_stripes> stripes_;
+};
+
+inline uint64_t histogram_snapshot::percentile(double p) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p * count + 0.5);
+    if (rank == 0) rank = 1;
+    if (rank > count) rank = count;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets.size(); ++b) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            uint64_t upper = b + 1 < histogram::bucket_count ? histogram::bucket_floor(b + 1) - 1 : max;
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+// Live counters of one map or multimap. The *_ns counters split the time
+// spent in its operations between encoding, LMDB calls and decoding.
+struct map_metrics {
+    explicit map_metrics(std::string n) : name(std::move(n)) {}
+
+    std::string name;
+    // inserts that found the key already there are not puts.
+    counter gets, hits, misses, puts, existing_inserts, erases, scans;
+    counter bytes_encoded, bytes_decoded;
+    counter encode_ns, lmdb_ns, decode_ns;
+    histogram get_latency, put_latency;
+};
+
+// Live counters of an environment's transactions. write_wait is the time
+// mdb_txn_begin blocks on the writer lock.
+struct environment_metrics {
+    counter read_txns, write_txns, commits, aborts;
+    histogram read_txn_duration, write_txn_duration, write_wait;
+};
+
+struct map_metrics_snapshot {
+    std::string name;
+    uint64_t gets = 0, hits = 0, misses = 0, puts = 0, existing_inserts = 0, erases = 0, scans = 0;
+    uint64_t bytes_encoded = 0, bytes_decoded = 0;
+    uint64_t encode_ns = 0, lmdb_ns = 0, decode_ns = 0;
+    histogram_snapshot get_latency, put_latency;
+
+    // From mdb_stat, as seen by the transaction the snapshot was taken in.
+    unsigned depth = 0;
+    size_t branch_pages = 0, leaf_pages = 0, overflow_pages = 0, entries = 0;
+};
+
+struct environment_metrics_snapshot {
+    uint64_t read_txns = 0, write_txns = 0, commits = 0, aborts = 0;
+    histogram_snapshot read_txn_duration, write_txn_duration, write_wait;
+
+    // From mdb_env_info and mdb_env_stat.
+    size_t map_size = 0, last_pgno = 0, last_txnid = 0;
+    unsigned max_readers = 0, num_readers = 0;
+    unsigned page_size = 0, depth = 0;
+    size_t branch_pages = 0, leaf_pages = 0, overflow_pages = 0, entries = 0;
+};
+
+namespace detail {
+
+// Times the phases of one map operation: each call charges the time since
+// the previous one to its phase, and the final one records the latency.
+class op_probe {
+public:
+    explicit op_probe(map_metrics& m) : m_(&m), start_(now_ns()), mark_(start_) {}
+
+    void encoded(size_t bytes) {
+        m_->encode_ns.add(lap());
+        m_->bytes_encoded.add(bytes);
+    }
+
+    void lmdb() { m_->lmdb_ns.add(lap()); }
+
+    void decoded(size_t bytes) {
+        m_->decode_ns.add(lap());
+        m_->bytes_decoded.add(bytes);
+    }
+
+    void get(bool hit) {
+        m_->gets.add(1);
+        (hit ? m_->hits : m_->misses).add(1);
+        m_->get_latency.record(now_ns() - start_);
+    }
+
+    // A batch of n lookups, found of them hits; no latency is recorded.
+    void get_many(size_t n, size_t found) {
+        m_->gets.add(n);
+        m_->hits.add(found);
+        m_->misses.add(n - found);
+    }
+
+    void put() {
+        m_->puts.add(1);
+        m_->put_latency.record(now_ns() - start_);
+    }
+
+    // An insert that wrote nothing; no latency is recorded.
+    void existing_insert() { m_->existing_inserts.add(1); }
+
+    void erase() { m_->erases.add(1); }
+    void scan() { m_->scans.add(1); }
+
+private:
+    map_metrics* m_;
+    uint64_t start_;
+    uint64_t mark_;
+
+    uint64_t lap() {
+        uint64_t now = now_ns();
+        uint64_t elapsed = now - mark_;
+        mark_ = now;
+        return elapsed;
+    }
+};
+
+inline map_metrics_snapshot snapshot(const map_metrics& m, MDB_txn* txn, MDB_dbi dbi) {
+    map_metrics_snapshot s;
+    s.name = m.name;
+    s.gets = m.gets.load();
+    s.hits = m.hits.load();
+    s.misses = m.misses.load();
+    s.puts = m.puts.load();
+    s.existing_inserts = m.existing_inserts.load();
+    s.erases = m.erases.load();
+    s.scans = m.scans.load();
+    s.bytes_encoded = m.bytes_encoded.load();
+    s.bytes_decoded = m.bytes_decoded.load();
+    s.encode_ns = m.encode_ns.load();
+    s.lmdb_ns = m.lmdb_ns.load();
+    s.decode_ns = m.decode_ns.load();
+    s.get_latency = m.get_latency.snapshot();
+    s.put_latency = m.put_latency.snapshot();
+
+    MDB_stat stat;
+    int rc = mdb_stat(txn, dbi, &stat);
+    if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+    s.depth = stat.ms_depth;
+    s.branch_pages = stat.ms_branch_pages;
+    s.leaf_pages = stat.ms_leaf_pages;
+    s.overflow_pages = stat.ms_overflow_pages;
+    s.entries = stat.ms_entries;
+    return s;
+}
+
+}
+
+#else
+
+namespace detail {
+
+struct op_probe {
+    void encoded(size_t) {}
+    void lmdb() {}
+    void decoded(size_t) {}
+    void get(bool) {}
+    void get_many(size_t, size_t) {}
+    void put() {}
+    void existing_insert() {}
+    void erase() {}
+    void scan() {}
+};
+
+}
+
+#endif
+
+}
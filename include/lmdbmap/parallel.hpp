@@ -0,0 +1,319 @@
+#pragma once
+#include "environment.hpp"
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include "error.hpp"
+#include <lmdb.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+
+namespace detail {
+
+class barrier {
+public:
+    explicit barrier(size_t count) : count_(count) {}
+
+    void arrive_and_wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        size_t generation = generation_;
+        if (++arrived_ == count_) {
+            arrived_ = 0;
+            ++generation_;
+            done_.notify_all();
+        } else {
+            done_.wait(lock, [&] { return generation_ != generation; });
+        }
+    }
+
+    // Leaves for good, for a participant that will never arrive.
+    void arrive_and_drop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--count_ == arrived_ && arrived_ != 0) {
+            arrived_ = 0;
+            ++generation_;
+            done_.notify_all();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    size_t count_;
+    size_t arrived_ = 0;
+    size_t generation_ = 0;
+};
+
+// Holds an environment's resize gate for the whole scan, so the map cannot
+// be resized while worker transactions, opened unguarded, are running.
+class gate_hold {
+public:
+    explicit gate_hold(resize_gate& gate) : gate_(gate) { gate_.enter(); }
+    ~gate_hold() { gate_.leave(); }
+
+    gate_hold(const gate_hold&) = delete;
+    gate_hold& operator=(const gate_hold&) = delete;
+
+private:
+    resize_gate& gate_;
+};
+
+inline std::string bytes_of(const MDB_val& v) {
+    return std::string(static_cast<const char*>(v.mv_data), v.mv_size);
+}
+
+// Up to parts - 1 keys that split dbi into ranges of similar size. LMDB does
+// not expose its branch pages, so candidates are interpolated between the
+// first and last key, using the first 8 bytes after their common prefix as
+// a number, and snapped to stored keys with MDB_SET_RANGE. Skewed key
+// spaces give uneven ranges, which the scan evens out by handing ranges to
+// workers as they become free.
+inline std::vector<std::string> split_points(transaction& txn, MDB_dbi dbi, size_t parts) {
+    std::vector<std::string> points;
+    MDB_cursor* cursor = txn.acquire_cursor(dbi);
+    MDB_val k, v;
+    int rc = mdb_cursor_get(cursor, &k, &v, MDB_FIRST);
+    if (rc == 0) {
+        std::string first = bytes_of(k);
+        rc = mdb_cursor_get(cursor, &k, &v, MDB_LAST);
+        std::string last = rc == 0 ? bytes_of(k) : first;
+
+        size_t prefix = 0;
+        while (prefix < first.size() && prefix < last.size() && first[prefix] == last[prefix]) ++prefix;
+        auto number = [&](const std::string& key) {
+            std::uint64_t n = 0;
+            for (size_t i = 0; i < 8; ++i) {
+                unsigned char c = prefix + i < key.size() ? static_cast<unsigned char>(key[prefix + i]) : 0;
+                n = (n << 8) | c;
+            }
+            return n;
+        };
+        std::uint64_t lo = number(first), hi = number(last);
+        std::uint64_t step = hi > lo ? (hi - lo) / parts : 0;
+
+        for (size_t i = 1; step != 0 && i < parts; ++i) {
+            std::string candidate = first.substr(0, prefix);
+            candidate.resize(prefix + 8);
+            store_big_endian<std::uint64_t>(lo + step * i, &candidate[prefix]);
+            while (candidate.size() > prefix + 1 && candidate.back() == '\0') candidate.pop_back();
+
+            k = MDB_val{candidate.size(), &candidate[0]};
+            rc = mdb_cursor_get(cursor, &k, &v, MDB_SET_RANGE);
+            if (rc == MDB_NOTFOUND) break;
+            if (rc != 0) {
+                txn.release_cursor(cursor);
+                throw std::runtime_error(mdb_strerror(rc));
+            }
+            std::string point = bytes_of(k);
+            if (point != first && (points.empty() || points.back() != point)) points.push_back(std::move(point));
+        }
+    } else if (rc != MDB_NOTFOUND) {
+        txn.release_cursor(cursor);
+        throw std::runtime_error(mdb_strerror(rc));
+    }
+    txn.release_cursor(cursor);
+    return points;
+}
+
+// Calls visit(k, v) for every entry with lo <= key < hi; a null bound is open.
+template<typename Visit>
+void scan_partition(MDB_cursor* cursor, const std::string* lo, const std::string* hi, Visit&& visit) {
+    MDB_val k, v;
+    int rc;
+    if (lo) {
+        k = MDB_val{lo->size(), const_cast<char*>(lo->data())};
+        rc = mdb_cursor_get(cursor, &k, &v, MDB_SET_RANGE);
+    } else {
+        rc = mdb_cursor_get(cursor, &k, &v, MDB_FIRST);
+    }
+    MDB_val end{0, nullptr};
+    if (hi) end = MDB_val{hi->size(), const_cast<char*>(hi->data())};
+    while (rc == 0 && (!hi || compare_bytes(k, end) < 0)) {
+        visit(k, v);
+        rc = mdb_cursor_get(cursor, &k, &v, MDB_NEXT);
+    }
+    if (rc != 0 && rc != MDB_NOTFOUND) throw std::runtime_error(mdb_strerror(rc));
+}
+
+// Times workers of a read-only environment try to begin on one snapshot
+// before the scan falls back to a single worker.
+constexpr size_t snapshot_attempts = 8;
+
+// Splits dbi into ranges and scans them on up to threads workers, each with
+// its own read-only transaction and cursor, all on one snapshot. Unless the
+// environment is read-only, the calling thread holds LMDB's writer lock
+// (an empty write transaction) while the workers begin, so no commit can
+// land in between. Otherwise workers that began on different snapshots
+// start over, and after snapshot_attempts tries one of them scans alone.
+// Calls visit(part, cursor, lo, hi) once per range and returns the number
+// of ranges.
+template<typename Visit>
+size_t parallel_scan(environment& env, MDB_dbi dbi, unsigned threads, Visit&& visit) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    const bool pinned = (env.flags() & MDB_RDONLY) == 0;
+
+    for (;;) {
+        std::atomic<bool> started{false};
+        try {
+            gate_hold hold(env.gate());
+            std::vector<std::string> bounds;
+            {
+                transaction txn(env, true, unguarded_t{});
+                bounds = split_points(txn, dbi, size_t(threads) * 8);
+            }
+            size_t parts = bounds.size() + 1;
+            size_t workers = std::min<size_t>(threads, parts);
+
+            std::vector<size_t> ids(workers);
+            std::atomic<size_t> next{0};
+            std::atomic<bool> failed{false};
+            std::exception_ptr error;
+            std::mutex error_mutex;
+            // When pinned, the calling thread holds the writer lock and
+            // only waits for the workers to begin.
+            barrier sync(pinned ? workers + 1 : workers);
+
+            auto fail = [&] {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            };
+
+            auto work = [&](size_t w) {
+                std::unique_ptr<transaction> txn;
+                for (size_t attempt = 1;; ++attempt) {
+                    try {
+                        txn = std::make_unique<transaction>(env, true, unguarded_t{});
+                        ids[w] = mdb_txn_id(*txn);
+                    } catch (...) {
+                        fail();
+                    }
+                    sync.arrive_and_wait();
+                    if (failed) return;
+                    if (pinned || std::all_of(ids.begin(), ids.end(), [&](size_t id) { return id == ids[0]; })) break;
+                    if (attempt == snapshot_attempts) {
+                        if (w != 0) return;
+                        break;
+                    }
+                    txn.reset();
+                    sync.arrive_and_wait();
+                }
+                try {
+                    for (size_t p; !failed && (p = next++) < parts;) {
+                        started = true;
+                        MDB_cursor* cursor = txn->acquire_cursor(dbi);
+                        try {
+                            visit(p, cursor, p == 0 ? nullptr : &bounds[p - 1], p < bounds.size() ? &bounds[p] : nullptr);
+                        } catch (...) {
+                            txn->release_cursor(cursor);
+                            throw;
+                        }
+                        txn->release_cursor(cursor);
+                    }
+                } catch (...) {
+                    fail();
+                }
+            };
+
+            // A write transaction and a read transaction may not share a
+            // thread, so when pinned every worker gets its own.
+            MDB_txn* writer = nullptr;
+            if (pinned) {
+                int rc = mdb_txn_begin(env, nullptr, 0, &writer);
+                if (rc != 0) throw_error(rc);
+            }
+            std::vector<std::thread> pool;
+            size_t spawned = pinned ? 0 : 1;
+            try {
+                for (; spawned < workers; ++spawned) pool.emplace_back(work, spawned);
+            } catch (...) {
+                fail();
+                for (size_t w = spawned; w < workers; ++w) sync.arrive_and_drop();
+            }
+            if (pinned) {
+                sync.arrive_and_wait();
+                mdb_txn_abort(writer);
+            } else if (spawned == workers) {
+                work(0);
+            } else {
+                sync.arrive_and_drop();
+            }
+            for (auto& t : pool) t.join();
+            if (error) std::rethrow_exception(error);
+            return parts;
+        } catch (const map_resized_error&) {
+            // Another process grew the map before any range was scanned.
+            if (started) throw;
+        }
+        env.adopt_map_size();
+    }
+}
+
+}
+
+// Calls fn(entry) for every entry of a map or multimap, in parallel. The
+// key space is split into ranges that up to threads workers (default: one
+// per core) scan on the same snapshot, each with its own read-only
+// transaction and cursor. fn runs concurrently on several threads, and
+// entries are visited in key order only within a range.
+//
+// Must not be called while this thread has a transaction open on env.
+template<typename Container, typename F>
+void parallel_for_each(environment& env, Container& container, F fn, unsigned threads = 0) {
+    using key_codec = typename Container::key_codec_type;
+    using value_codec = typename Container::value_codec_type;
+    detail::parallel_scan(env, container.dbi(), threads,
+        [&](size_t, MDB_cursor* cursor, const std::string* lo, const std::string* hi) {
+            detail::scan_partition(cursor, lo, hi, [&](const MDB_val& k, const MDB_val& v) {
+                const typename Container::value_type entry(key_codec::decode(k.mv_data, k.mv_size),
+                                                           value_codec::decode(v.mv_data, v.mv_size));
+                fn(entry);
+            });
+        });
+}
+
+// Folds every entry of a map or multimap in parallel: each range is folded
+// from init with acc = accumulate(std::move(acc), entry), and the per-range
+// results are merged in key order with combine(std::move(a), std::move(b)).
+// As with std::reduce, init should be an identity of combine.
+template<typename Container, typename Acc, typename Accumulate, typename Combine>
+Acc parallel_reduce(environment& env, Container& container, Acc init, Accumulate accumulate, Combine combine,
+                    unsigned threads = 0) {
+    using key_codec = typename Container::key_codec_type;
+    using value_codec = typename Container::value_codec_type;
+    std::vector<std::optional<Acc>> results;
+    std::mutex results_mutex;
+    detail::parallel_scan(env, container.dbi(), threads,
+        [&](size_t part, MDB_cursor* cursor, const std::string* lo, const std::string* hi) {
+            Acc acc = init;
+            detail::scan_partition(cursor, lo, hi, [&](const MDB_val& k, const MDB_val& v) {
+                const typename Container::value_type entry(key_codec::decode(k.mv_data, k.mv_size),
+                                                           value_codec::decode(v.mv_data, v.mv_size));
+                acc = accumulate(std::move(acc), entry);
+            });
+            std::lock_guard<std::mutex> lock(results_mutex);
+            if (results.size() <= part) results.resize(part + 1);
+            results[part] = std::move(acc);
+        });
+
+    std::optional<Acc> total;
+    for (auto& r : results) {
+        if (!r) continue;
+        total = total ? combine(std::move(*total), std::move(*r)) : std::move(*r);
+    }
+    return total ? std::move(*total) : init;
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "transaction.hpp"
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace lmdbmap {
+
+// Adapts a map or multimap iterator to yield only keys (Keys = true) or only
+// values, so the other half of each entry is never decoded.
+template<typename Iterator, bool Keys>
+class projection_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::conditional_t<Keys, typename Iterator::value_type::first_type,
+                                          typename Iterator::value_type::second_type>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    projection_iterator() = default;
+    explicit projection_iterator(Iterator it) : it_(std::move(it)) {}
+
+    reference operator*() const {
+        if constexpr (Keys) {
+            return it_.key();
+        } else {
+            return it_.value();
+        }
+    }
+    pointer operator->() const { return &**this; }
+
+    projection_iterator& operator++() {
+        ++it_;
+        return *this;
+    }
+
+    projection_iterator operator++(int) {
+        projection_iterator tmp = *this;
+        ++it_;
+        return tmp;
+    }
+
+    bool operator==(const projection_iterator& other) const { return it_ == other.it_; }
+    bool operator!=(const projection_iterator& other) const { return it_ != other.it_; }
+
+    const Iterator& base() const { return it_; }
+
+private:
+    Iterator it_;
+};
+
+template<typename Container, bool Keys>
+struct projection_range {
+    using iterator = projection_iterator<typename Container::iterator, Keys>;
+
+    Container& map_;
+    transaction& txn_;
+
+    iterator begin() { return iterator(map_.begin(txn_)); }
+    iterator end() { return iterator(map_.end(txn_)); }
+};
+
+}
@@ -0,0 +1,229 @@
+#pragma once
+#include "serialization.hpp"
+#include "transaction.hpp"
+#include "view.hpp"
+#include <lmdb.h>
+#include <iterator>
+#include <string>
+#include <cstring>
+#include <utility>
+
+namespace lmdbmap {
+
+// Walks a map or multimap backwards. Unlike std::reverse_iterator it wraps
+// an iterator at the entry itself rather than one past it, because map
+// iterators own the entry they decode and std::reverse_iterator would hand
+// out references into a temporary.
+template<typename Iterator>
+class reverse_iterator {
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename Iterator::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = typename Iterator::pointer;
+    using reference = typename Iterator::reference;
+
+    reverse_iterator() = default;
+    explicit reverse_iterator(Iterator it) : it_(std::move(it)) {}
+
+    reference operator*() { return *it_; }
+    pointer operator->() { return it_.operator->(); }
+
+    decltype(auto) key() const { return it_.key(); }
+    decltype(auto) value() const { return it_.value(); }
+    byte_view key_view() const { return it_.key_view(); }
+    byte_view value_view() const { return it_.value_view(); }
+
+    reverse_iterator& operator++() {
+        --it_;
+        return *this;
+    }
+
+    reverse_iterator operator++(int) {
+        reverse_iterator tmp = *this;
+        --it_;
+        return tmp;
+    }
+
+    reverse_iterator& operator--() {
+        ++it_;
+        return *this;
+    }
+
+    reverse_iterator operator--(int) {
+        reverse_iterator tmp = *this;
+        ++it_;
+        return tmp;
+    }
+
+    bool operator==(const reverse_iterator& other) const { return it_ == other.it_; }
+    bool operator!=(const reverse_iterator& other) const { return it_ != other.it_; }
+
+    // The forward iterator at the same entry.
+    const Iterator& base() const { return it_; }
+
+private:
+    Iterator it_;
+};
+
+// Entries of a map or multimap with keys between lo and hi. Iteration stops
+// at the first key past hi, found by comparing encoded bytes, so nothing
+// beyond the range is decoded. Iterators must not outlive the range.
+template<typename Container>
+class bounded_range {
+public:
+    using key_type = typename Container::key_type;
+    using base_iterator = typename Container::iterator;
+
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename base_iterator::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename base_iterator::pointer;
+        using reference = typename base_iterator::reference;
+
+        iterator() = default;
+
+        iterator(base_iterator it, const bounded_range* range) : it_(std::move(it)), range_(range) {
+            clamp();
+        }
+
+        reference operator*() { return *it_; }
+        pointer operator->() { return it_.operator->(); }
+
+        decltype(auto) key() const { return it_.key(); }
+        decltype(auto) value() const { return it_.value(); }
+        byte_view key_view() const { return it_.key_view(); }
+        byte_view value_view() const { return it_.value_view(); }
+
+        iterator& operator++() {
+            ++it_;
+            clamp();
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        bool operator==(const iterator& other) const { return it_ == other.it_; }
+        bool operator!=(const iterator& other) const { return it_ != other.it_; }
+
+        const base_iterator& base() const { return it_; }
+
+    private:
+        base_iterator it_;
+        const bounded_range* range_ = nullptr;
+
+        void clamp() {
+            if (range_ && it_ != base_iterator() && range_->past_end(it_.key_view())) it_ = base_iterator();
+        }
+    };
+
+    bounded_range(Container& container, transaction& txn, const key_type& lo, const key_type& hi,
+                  bool include_lo, bool include_hi)
+        : container_(container), txn_(txn), lo_(lo), include_lo_(include_lo), include_hi_(include_hi) {
+        auto bytes = Container::key_codec_type::encode(hi);
+        hi_.assign(bytes.data(), bytes.size());
+    }
+
+    iterator begin() {
+        return iterator(include_lo_ ? container_.lower_bound(txn_, lo_) : container_.upper_bound(txn_, lo_), this);
+    }
+
+    iterator end() { return iterator(); }
+
+private:
+    Container& container_;
+    transaction& txn_;
+    key_type lo_;
+    std::string hi_;
+    bool include_lo_;
+    bool include_hi_;
+
+    bool past_end(const byte_view& key) const {
+        MDB_val k{key.size(), const_cast<char*>(key.data())};
+        MDB_val hi{hi_.size(), const_cast<char*>(hi_.data())};
+        int c = compare_bytes(k, hi);
+        return include_hi_ ? c > 0 : c >= 0;
+    }
+};
+
+// Entries of a map or multimap whose encoded key starts with prefix. The
+// scan starts with one MDB_SET_RANGE seek and stops at the first key without
+// the prefix. Iterators must not outlive the range.
+template<typename Container>
+class prefixed_range {
+public:
+    using base_iterator = typename Container::iterator;
+
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename base_iterator::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename base_iterator::pointer;
+        using reference = typename base_iterator::reference;
+
+        iterator() = default;
+
+        iterator(base_iterator it, const prefixed_range* range) : it_(std::move(it)), range_(range) {
+            clamp();
+        }
+
+        reference operator*() { return *it_; }
+        pointer operator->() { return it_.operator->(); }
+
+        decltype(auto) key() const { return it_.key(); }
+        decltype(auto) value() const { return it_.value(); }
+        byte_view key_view() const { return it_.key_view(); }
+        byte_view value_view() const { return it_.value_view(); }
+
+        iterator& operator++() {
+            ++it_;
+            clamp();
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        bool operator==(const iterator& other) const { return it_ == other.it_; }
+        bool operator!=(const iterator& other) const { return it_ != other.it_; }
+
+        const base_iterator& base() const { return it_; }
+
+    private:
+        base_iterator it_;
+        const prefixed_range* range_ = nullptr;
+
+        void clamp() {
+            if (range_ && it_ != base_iterator() && !range_->matches(it_.key_view())) it_ = base_iterator();
+        }
+    };
+
+    prefixed_range(Container& container, transaction& txn, std::string prefix)
+        : container_(container), txn_(txn), prefix_(std::move(prefix)) {}
+
+    iterator begin() { return iterator(container_.lower_bound_encoded(txn_, prefix_), this); }
+    iterator end() { return iterator(); }
+
+    const std::string& prefix() const { return prefix_; }
+
+private:
+    Container& container_;
+    transaction& txn_;
+    std::string prefix_;
+
+    bool matches(const byte_view& key) const {
+        return key.size() >= prefix_.size() && std::memcmp(key.data(), prefix_.data(), prefix_.size()) == 0;
+    }
+};
+
+}
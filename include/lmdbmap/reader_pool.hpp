@@ -0,0 +1,156 @@
+#pragma once
+#include <lmdb.h>
+#include "error.hpp"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+namespace detail {
+
+// A read-only transaction parked by reader_pool, together with the cursors
+// that were open on it.
+struct pooled_reader {
+    MDB_txn* txn = nullptr;
+    std::vector<MDB_cursor*> cursors;
+};
+
+// Recycles read-only transactions with mdb_txn_reset/mdb_txn_renew instead
+// of mdb_txn_begin/mdb_txn_abort. Without MDB_NOTLS every thread keeps its
+// idle reader in a thread-local slot; with MDB_NOTLS readers own their lock
+// table slot and are shared through a common idle list, so they can move
+// between the threads of an executor.
+class reader_pool : public std::enable_shared_from_this<reader_pool> {
+public:
+    reader_pool(MDB_env* env, bool notls) : env_(env), notls_(notls) {}
+
+    reader_pool(const reader_pool&) = delete;
+    reader_pool& operator=(const reader_pool&) = delete;
+
+    pooled_reader* acquire() {
+        pooled_reader* reader = notls_ ? nullptr : take_local();
+        if (!reader) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!idle_.empty()) {
+                reader = idle_.back();
+                idle_.pop_back();
+            }
+        }
+        if (reader) {
+            renew(reader);
+            return reader;
+        }
+
+        MDB_txn* txn;
+        int rc = mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn);
+        if (rc != 0) throw_error(rc);
+        std::lock_guard<std::mutex> lock(mutex_);
+        readers_.emplace_back();
+        readers_.back().txn = txn;
+        return &readers_.back();
+    }
+
+    void release(pooled_reader* reader) {
+        mdb_txn_reset(reader->txn);
+        if (!notls_ && put_local(reader)) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(reader);
+    }
+
+    // Aborts every pooled transaction. Called by environment before
+    // mdb_env_close; readers still checked out at this point are invalid.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (pooled_reader& reader : readers_) {
+            for (MDB_cursor* cursor : reader.cursors) mdb_cursor_close(cursor);
+            mdb_txn_abort(reader.txn);
+        }
+        readers_.clear();
+        idle_.clear();
+        closed_ = true;
+    }
+
+private:
+    struct local_slot {
+        const reader_pool* pool;
+        std::weak_ptr<reader_pool> owner;
+        pooled_reader* reader;
+    };
+
+    // Idle readers parked by this thread, at most one per pool. They are
+    // handed back to their pool's shared list when the thread exits.
+    struct local_cache {
+        std::vector<local_slot> slots;
+
+        ~local_cache() {
+            for (local_slot& slot : slots) {
+                if (auto pool = slot.owner.lock()) pool->give_back(slot.reader);
+            }
+        }
+    };
+
+    static local_cache& local() {
+        thread_local local_cache cache;
+        return cache;
+    }
+
+    pooled_reader* take_local() {
+        auto& slots = local().slots;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].owner.expired()) {
+                slots[i] = slots.back();
+                slots.pop_back();
+                --i;
+            } else if (slots[i].pool == this) {
+                pooled_reader* reader = slots[i].reader;
+                slots[i] = slots.back();
+                slots.pop_back();
+                return reader;
+            }
+        }
+        return nullptr;
+    }
+
+    bool put_local(pooled_reader* reader) {
+        auto& slots = local().slots;
+        for (const local_slot& slot : slots) {
+            if (slot.pool == this && !slot.owner.expired()) return false;
+        }
+        slots.push_back({this, weak_from_this(), reader});
+        return true;
+    }
+
+    void give_back(pooled_reader* reader) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!closed_) idle_.push_back(reader);
+    }
+
+    void renew(pooled_reader* reader) {
+        int rc = mdb_txn_renew(reader->txn);
+        if (rc != 0) {
+            give_back(reader);
+            throw_error(rc);
+        }
+        for (MDB_cursor* cursor : reader->cursors) {
+            if (mdb_cursor_renew(reader->txn, cursor) != 0) {
+                // Cached cursors are only an optimization, drop them.
+                for (MDB_cursor* c : reader->cursors) mdb_cursor_close(c);
+                reader->cursors.clear();
+                break;
+            }
+        }
+    }
+
+    MDB_env* env_;
+    bool notls_;
+    std::mutex mutex_;
+    std::list<pooled_reader> readers_;
+    std::vector<pooled_reader*> idle_;
+    bool closed_ = false;
+};
+
+}
+}
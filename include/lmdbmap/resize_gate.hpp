@@ -0,0 +1,158 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+namespace detail {
+
+// mdb_env_set_mapsize remaps the file, so it may only run while no
+// transaction of this process is open on the environment, readers
+// included: their pages and views point into the old mapping. Every
+// transaction holds the gate shared for its lifetime; a resize closes it,
+// waits for the open ones to finish and runs alone.
+//
+// Open transactions are counted in gate_stripes cache-line sized counters,
+// one picked per thread, so entering is an increment on a line other
+// threads rarely touch; only a resize sums them.
+class resize_gate {
+public:
+    resize_gate() = default;
+    resize_gate(const resize_gate&) = delete;
+    resize_gate& operator=(const resize_gate&) = delete;
+
+    void enter() {
+        thread_state& here = state();
+        std::atomic<long>& open = stripes_[here.stripe].open;
+        for (;;) {
+            open.fetch_add(1);
+            if (!resizing_.load()) break;
+            open.fetch_sub(1);
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.notify_all();
+            changed_.wait(lock, [&] { return !resizing_.load(); });
+        }
+        count_here(here, 1);
+    }
+
+    void leave() {
+        thread_state& here = state();
+        count_here(here, -1);
+        stripes_[here.stripe].open.fetch_sub(1);
+        if (resizing_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            changed_.notify_all();
+        }
+    }
+
+    // Runs fn once every open transaction has ended and returns true. If
+    // other transactions are still open after timeout (a thread waiting for
+    // this one while it holds a transaction, say), gives up and returns
+    // false without running fn. Throws if the calling thread itself has a
+    // transaction open, which could never end.
+    template<typename F>
+    bool exclusive(std::chrono::milliseconds timeout, F&& fn) {
+        if (held_here()) {
+            throw std::logic_error("lmdbmap: cannot resize the map while this thread has a transaction open");
+        }
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!changed_.wait_until(lock, deadline, [&] { return !resizing_.load(); })) return false;
+        resizing_.store(true);
+        if (!changed_.wait_until(lock, deadline, [&] { return open() == 0; })) {
+            resizing_.store(false);
+            changed_.notify_all();
+            return false;
+        }
+        try {
+            fn();
+        } catch (...) {
+            resizing_.store(false);
+            changed_.notify_all();
+            throw;
+        }
+        resizing_.store(false);
+        changed_.notify_all();
+        return true;
+    }
+
+private:
+    static constexpr size_t gate_stripes = 16;
+
+    struct alignas(64) stripe {
+        // May go negative when a transaction ends on another thread than
+        // it began on; only the sum is meaningful.
+        std::atomic<long> open{0};
+    };
+
+    // Per thread: its stripe, and the transactions it holds on one gate.
+    // Threads holding transactions on several gates at once, which is
+    // rare, keep the others in more_held().
+    struct thread_state {
+        size_t stripe;
+        const resize_gate* gate;
+        long held;
+    };
+
+    std::array<stripe, gate_stripes> stripes_;
+    std::atomic<bool> resizing_{false};
+    std::mutex mutex_;
+    std::condition_variable changed_;
+
+    static thread_state& state() {
+        static std::atomic<size_t> next{0};
+        thread_local thread_state here{next.fetch_add(1, std::memory_order_relaxed) % gate_stripes, nullptr, 0};
+        return here;
+    }
+
+    static std::vector<std::pair<const resize_gate*, long>>& more_held() {
+        thread_local std::vector<std::pair<const resize_gate*, long>> held;
+        return held;
+    }
+
+    long open() const {
+        long sum = 0;
+        for (const stripe& s : stripes_) sum += s.open.load();
+        return sum;
+    }
+
+    // Best effort: with MDB_NOTLS a transaction may end on another thread
+    // than it began on.
+    void count_here(thread_state& here, long delta) {
+        if (here.gate == this || here.gate == nullptr) {
+            here.gate = this;
+            here.held += delta;
+            if (here.held == 0) here.gate = nullptr;
+            return;
+        }
+        auto& held = more_held();
+        for (auto& entry : held) {
+            if (entry.first != this) continue;
+            entry.second += delta;
+            if (entry.second == 0) {
+                entry = held.back();
+                held.pop_back();
+            }
+            return;
+        }
+        held.emplace_back(this, delta);
+    }
+
+    bool held_here() {
+        thread_state& here = state();
+        long held = here.gate == this ? here.held : 0;
+        for (const auto& entry : more_held()) {
+            if (entry.first == this) held += entry.second;
+        }
+        return held > 0;
+    }
+};
+
+}
+}
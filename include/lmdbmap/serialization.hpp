@@ -5,11 +5,120 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/map.hpp>
 #include <sstream>
+#include <streambuf>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <lmdb.h>
 
 namespace lmdbmap {
 
+namespace detail {
+
+// Read-only streambuf over a caller-owned buffer, so archives can read an
+// MDB_val in place instead of copying it into a string first.
+class memory_streambuf : public std::streambuf {
+public:
+    memory_streambuf(const void* data, size_t size) {
+        char* p = const_cast<char*>(static_cast<const char*>(data));
+        setg(p, p, p + size);
+    }
+};
+
+// Write-only streambuf appending to a caller-owned string, so archives can
+// write into a reused buffer instead of a fresh ostringstream.
+class string_streambuf : public std::streambuf {
+public:
+    explicit string_streambuf(std::string& out) : out_(out) {}
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        out_.append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) out_.push_back(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+
+private:
+    std::string& out_;
+};
+
+// A per-thread encode buffer that keeps its capacity between uses, so
+// encoding a value does not allocate once the thread has seen one as large.
+// Encoders may nest (compressed_codec encodes with its inner codec first),
+// so each scratch takes its own buffer off the thread's free list and gives
+// it back when done. Buffers over max_kept bytes are freed instead.
+class scratch {
+public:
+    static constexpr size_t max_kept = size_t(1) << 20;
+
+    scratch() {
+        auto& free = free_list();
+        if (!free.empty()) {
+            bytes_ = std::move(free.back());
+            free.pop_back();
+        }
+    }
+
+    ~scratch() {
+        if (bytes_.capacity() > max_kept) return;
+        bytes_.clear();
+        try {
+            free_list().push_back(std::move(bytes_));
+        } catch (...) {
+        }
+    }
+
+    scratch(const scratch&) = delete;
+    scratch& operator=(const scratch&) = delete;
+
+    std::string& bytes() { return bytes_; }
+
+private:
+    std::string bytes_;
+
+    static std::vector<std::string>& free_list() {
+        thread_local std::vector<std::string> free;
+        return free;
+    }
+};
+
+// The environment that values encoded on this thread are written to, for
+// codecs whose output depends on it: compressed_codec only compresses with
+// dictionaries stored there. Set around value encodes that know it;
+// nullptr elsewhere.
+class encode_target {
+public:
+    explicit encode_target(MDB_env* env) : previous_(current()) { current() = env; }
+    ~encode_target() { current() = previous_; }
+
+    encode_target(const encode_target&) = delete;
+    encode_target& operator=(const encode_target&) = delete;
+
+    static MDB_env* get() { return current(); }
+
+private:
+    MDB_env* previous_;
+
+    static MDB_env*& current() {
+        thread_local MDB_env* env = nullptr;
+        return env;
+    }
+};
+
+}
+
 template<typename T>
 std::string serialize(const T& obj) {
     std::ostringstream oss;
@@ -20,9 +129,8 @@ std::string serialize(const T& obj) {
 
 template<typename T>
 T deserialize(const void* data, size_t size) {
-    std::string s(static_cast<const char*>(data), size);
-    std::istringstream iss(s);
-    boost::archive::binary_iarchive ia(iss);
+    detail::memory_streambuf buf(data, size);
+    boost::archive::binary_iarchive ia(buf);
     T obj;
     ia >> obj;
     return obj;
@@ -33,4 +141,339 @@ T deserialize(const MDB_val& val) {
     return deserialize<T>(val.mv_data, val.mv_size);
 }
 
+// A codec turns an object into bytes and back:
+//
+//   static <bytes> encode(const T& obj);   // <bytes> has data() and size()
+//   static T decode(const void* data, size_t size);
+//
+// encode() may return an owning buffer (std::string, std::array) or a
+// std::string_view borrowing from obj; the result is only used while obj
+// is alive.
+//
+// A value codec may also provide
+//
+//   static size_t encoded_size(const T& obj);
+//   static void encode_into(const T& obj, void* out, size_t size);  // size == encoded_size(obj)
+//
+// map then reserves the value's space with MDB_RESERVE and encodes straight
+// into the database page, instead of into a temporary that LMDB copies.
+// Only worth it when encoded_size is cheap. A codec that has to encode to
+// learn the size can instead provide
+//
+//   static void encode_to(const T& obj, std::string& out);  // out is empty
+//
+// and map encodes into a per-thread buffer that is reused from put to put,
+// so the only copy is LMDB's.
+
+template<typename T>
+struct boost_codec {
+    static std::string encode(const T& obj) { return serialize(obj); }
+    static void encode_to(const T& obj, std::string& out) {
+        detail::string_streambuf buf(out);
+        boost::archive::binary_oarchive oa(buf);
+        oa << obj;
+    }
+    static T decode(const void* data, size_t size) { return deserialize<T>(data, size); }
+};
+
+namespace detail {
+
+template<typename U>
+void store_big_endian(U v, char* out) {
+    for (size_t i = 0; i < sizeof(U); ++i) {
+        out[i] = static_cast<char>(v >> (8 * (sizeof(U) - 1 - i)));
+    }
+}
+
+template<typename U>
+U load_big_endian(const void* data) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    U v = 0;
+    for (size_t i = 0; i < sizeof(U); ++i) {
+        v = static_cast<U>((v << 8) | p[i]);
+    }
+    return v;
+}
+
+inline void check_size(size_t actual, size_t expected) {
+    if (actual != expected) throw std::runtime_error("lmdbmap: encoded size mismatch");
+}
+
+template<size_t N> struct uint_of_size;
+template<> struct uint_of_size<4> { using type = std::uint32_t; };
+template<> struct uint_of_size<8> { using type = std::uint64_t; };
+
+}
+
+// Keys are compared by LMDB as raw bytes, so key codecs must produce
+// encodings whose byte order matches the natural order of Key. Types
+// without a built-in order-preserving encoding fall back to Boost, which
+// round-trips but does not order.
+template<typename Key, typename Enable = void>
+struct key_codec : boost_codec<Key> {};
+
+// Integers: big-endian with the sign bit flipped, so negatives sort first.
+template<typename Key>
+struct key_codec<Key, std::enable_if_t<std::is_integral_v<Key> && !std::is_same_v<Key, bool>>> {
+    using U = std::make_unsigned_t<Key>;
+    static constexpr U sign_bit = std::is_signed_v<Key> ? static_cast<U>(U(1) << (sizeof(U) * 8 - 1)) : U(0);
+
+    static std::array<char, sizeof(Key)> encode(const Key& key) {
+        std::array<char, sizeof(Key)> out;
+        detail::store_big_endian<U>(static_cast<U>(static_cast<U>(key) ^ sign_bit), out.data());
+        return out;
+    }
+
+    static Key decode(const void* data, size_t size) {
+        detail::check_size(size, sizeof(Key));
+        return static_cast<Key>(static_cast<U>(detail::load_big_endian<U>(data) ^ sign_bit));
+    }
+};
+
+// IEEE floats: positives get the sign bit set, negatives are inverted.
+template<typename Key>
+struct key_codec<Key, std::enable_if_t<std::is_floating_point_v<Key> && std::numeric_limits<Key>::is_iec559 &&
+                                       (sizeof(Key) == 4 || sizeof(Key) == 8)>> {
+    using U = typename detail::uint_of_size<sizeof(Key)>::type;
+    static constexpr U sign_bit = U(1) << (sizeof(U) * 8 - 1);
+
+    static std::array<char, sizeof(Key)> encode(const Key& key) {
+        U bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        bits = (bits & sign_bit) ? static_cast<U>(~bits) : static_cast<U>(bits | sign_bit);
+        std::array<char, sizeof(Key)> out;
+        detail::store_big_endian<U>(bits, out.data());
+        return out;
+    }
+
+    static Key decode(const void* data, size_t size) {
+        detail::check_size(size, sizeof(Key));
+        U bits = detail::load_big_endian<U>(data);
+        bits = (bits & sign_bit) ? static_cast<U>(bits & ~sign_bit) : static_cast<U>(~bits);
+        Key key;
+        std::memcpy(&key, &bits, sizeof(key));
+        return key;
+    }
+};
+
+// Enums order by their underlying integer.
+template<typename Key>
+struct key_codec<Key, std::enable_if_t<std::is_enum_v<Key>>> {
+    using base = key_codec<std::underlying_type_t<Key>>;
+
+    static auto encode(const Key& key) { return base::encode(static_cast<std::underlying_type_t<Key>>(key)); }
+    static Key decode(const void* data, size_t size) { return static_cast<Key>(base::decode(data, size)); }
+};
+
+// Strings are stored as their raw bytes, which LMDB orders lexicographically.
+template<>
+struct key_codec<std::string> {
+    static std::string_view encode(const std::string& key) { return key; }
+    static std::string decode(const void* data, size_t size) {
+        return std::string(static_cast<const char*>(data), size);
+    }
+};
+
+namespace detail {
+
+// One component of a composite key. Each encoding sorts like the component
+// and is self-delimiting, so concatenating them sorts like the tuple.
+template<typename T, typename Enable = void>
+struct key_part {
+    static constexpr bool ordered = false;
+};
+
+// Fixed-width ordered encodings are simply concatenated.
+template<typename T>
+struct key_part<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>> {
+    static constexpr bool ordered = !std::is_base_of_v<boost_codec<T>, key_codec<T>>;
+    static constexpr size_t size = sizeof(T);
+
+    static void append(std::string& out, const T& part) {
+        auto bytes = key_codec<T>::encode(part);
+        out.append(bytes.data(), bytes.size());
+    }
+
+    static T read(const char*& p, const char* end) {
+        if (static_cast<size_t>(end - p) < size) throw std::runtime_error("lmdbmap: truncated composite key");
+        T part = key_codec<T>::decode(p, size);
+        p += size;
+        return part;
+    }
+};
+
+// Strings escape 0x00 as 0x00 0xff and end with 0x00 0x00, so a string sorts
+// before its extensions and the terminator never occurs inside one.
+template<>
+struct key_part<std::string> {
+    static constexpr bool ordered = true;
+
+    static void append(std::string& out, const std::string& part) {
+        for (char c : part) {
+            out.push_back(c);
+            if (c == '\0') out.push_back('\xff');
+        }
+        out.append(2, '\0');
+    }
+
+    static std::string read(const char*& p, const char* end) {
+        std::string part;
+        for (;;) {
+            if (end - p < 2) throw std::runtime_error("lmdbmap: truncated composite key");
+            char c = *p++;
+            if (c != '\0') {
+                part.push_back(c);
+            } else if (*p++ == '\0') {
+                return part;
+            } else {
+                part.push_back('\0');
+            }
+        }
+    }
+};
+
+}
+
+// Tuples of integers, floats, enums and strings are encoded component by
+// component, so keys sort by the first component, then the second, and so
+// on. encode_prefix encodes only the leading components; its bytes are a
+// prefix of the key of every tuple starting with them, which is what
+// prefix_range() scans for.
+template<typename... Ts>
+struct key_codec<std::tuple<Ts...>, std::enable_if_t<(detail::key_part<Ts>::ordered && ...)>> {
+    using tuple_type = std::tuple<Ts...>;
+
+    static std::string encode(const tuple_type& key) {
+        return std::apply([](const Ts&... parts) { return encode_prefix(parts...); }, key);
+    }
+
+    static tuple_type decode(const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        const char* end = p + size;
+        // Braced initialization reads the components left to right.
+        tuple_type key{detail::key_part<Ts>::read(p, end)...};
+        if (p != end) throw std::runtime_error("lmdbmap: trailing bytes in composite key");
+        return key;
+    }
+
+    template<typename... Parts>
+    static std::string encode_prefix(const Parts&... parts) {
+        static_assert(sizeof...(Parts) <= sizeof...(Ts), "lmdbmap: prefix longer than the key");
+        std::string out;
+        append<0>(out, parts...);
+        return out;
+    }
+
+private:
+    template<size_t I, typename Part, typename... Rest>
+    static void append(std::string& out, const Part& part, const Rest&... rest) {
+        using T = std::tuple_element_t<I, tuple_type>;
+        const T& value = part;
+        detail::key_part<T>::append(out, value);
+        append<I + 1>(out, rest...);
+    }
+
+    template<size_t I>
+    static void append(std::string&) {}
+};
+
+// Values only need to round-trip. Anything without a cheaper encoding goes
+// through Boost.
+template<typename T, typename Enable = void>
+struct value_codec : boost_codec<T> {};
+
+// Trivially copyable values are stored as their object representation.
+// Padding bytes are copied as-is, and multimap compares duplicates
+// bytewise, so multimap value types should not have padding.
+template<typename T>
+struct value_codec<T, std::enable_if_t<std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>>> {
+    static std::string_view encode(const T& obj) {
+        return std::string_view(reinterpret_cast<const char*>(&obj), sizeof(T));
+    }
+
+    static T decode(const void* data, size_t size) {
+        detail::check_size(size, sizeof(T));
+        T obj;
+        std::memcpy(&obj, data, sizeof(T));
+        return obj;
+    }
+};
+
+// Strings are stored as their raw bytes, so byte views see the payload.
+template<>
+struct value_codec<std::string> : key_codec<std::string> {};
+
+template<typename Bytes>
+MDB_val to_mdb_val(const Bytes& bytes) {
+    return MDB_val{bytes.size(), const_cast<char*>(bytes.data())};
+}
+
+inline bool equal_bytes(const MDB_val& a, const MDB_val& b) {
+    return a.mv_size == b.mv_size && std::memcmp(a.mv_data, b.mv_data, a.mv_size) == 0;
+}
+
+// LMDB's default key order: memcmp, then shorter first.
+inline int compare_bytes(const MDB_val& a, const MDB_val& b) {
+    size_t n = a.mv_size < b.mv_size ? a.mv_size : b.mv_size;
+    int c = n ? std::memcmp(a.mv_data, b.mv_data, n) : 0;
+    if (c != 0) return c;
+    return a.mv_size < b.mv_size ? -1 : (a.mv_size > b.mv_size ? 1 : 0);
+}
+
+namespace detail {
+
+template<typename Codec, typename T, typename = void>
+struct has_encode_into : std::false_type {};
+
+template<typename Codec, typename T>
+struct has_encode_into<Codec, T, std::void_t<
+    decltype(Codec::encoded_size(std::declval<const T&>())),
+    decltype(Codec::encode_into(std::declval<const T&>(), std::declval<void*>(), size_t()))>> : std::true_type {};
+
+template<typename Codec, typename T, typename = void>
+struct has_encode_to : std::false_type {};
+
+template<typename Codec, typename T>
+struct has_encode_to<Codec, T, std::void_t<
+    decltype(Codec::encode_to(std::declval<const T&>(), std::declval<std::string&>()))>> : std::true_type {};
+
+// mdb_put for an encoded key and a value still to be encoded. Codecs with
+// encode_into write into space reserved with MDB_RESERVE, which databases
+// with MDB_DUPSORT do not allow. If encode_into throws, the reserved value
+// is garbage and the transaction must be aborted. Codecs with encode_to
+// write into a scratch buffer. probe is told when the value has been
+// encoded and when mdb_put returned, see op_probe; with MDB_RESERVE, sizing
+// and encode_into count as encoding, not as LMDB time.
+template<typename Codec, typename T, typename Probe>
+int put_value(MDB_txn* txn, MDB_dbi dbi, MDB_val* key, const T& value, unsigned int flags, Probe& probe) {
+    encode_target target(mdb_txn_env(txn));
+    if constexpr (has_encode_into<Codec, T>::value) {
+        MDB_val data{Codec::encoded_size(value), nullptr};
+        probe.encoded(0);
+        int rc = mdb_put(txn, dbi, key, &data, flags | MDB_RESERVE);
+        probe.lmdb();
+        if (rc != 0) return rc;
+        Codec::encode_into(value, data.mv_data, data.mv_size);
+        probe.encoded(data.mv_size);
+        return rc;
+    } else if constexpr (has_encode_to<Codec, T>::value) {
+        scratch buf;
+        Codec::encode_to(value, buf.bytes());
+        MDB_val data = to_mdb_val(buf.bytes());
+        probe.encoded(data.mv_size);
+        int rc = mdb_put(txn, dbi, key, &data, flags);
+        probe.lmdb();
+        return rc;
+    } else {
+        auto bytes = Codec::encode(value);
+        MDB_val data = to_mdb_val(bytes);
+        probe.encoded(data.mv_size);
+        int rc = mdb_put(txn, dbi, key, &data, flags);
+        probe.lmdb();
+        return rc;
+    }
+}
+
+}
+
 }
@@ -0,0 +1,389 @@
+#pragma once
+#include "environment.hpp"
+#include "transaction.hpp"
+#include "serialization.hpp"
+#include "map.hpp"
+#include "parallel.hpp"
+#include "io_pool.hpp"
+#include <lmdb.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lmdbmap {
+
+namespace detail {
+
+// FNV-1a over the encoded key, with a final mix so that the low bits used
+// for the shard number depend on every byte. Stable across processes and
+// platforms, unlike std::hash.
+inline std::uint64_t shard_hash(const char* data, size_t size) {
+    std::uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+inline std::string shard_path(const std::string& path, size_t shard) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "shard-%03zu", shard);
+    return path + "/" + name;
+}
+
+}
+
+// A map partitioned by a hash of the encoded key across shards
+// environments in path/shard-000, path/shard-001, ... Each shard has its
+// own writer lock, so writes to different shards commit in parallel and
+// ingest scales with cores instead of serializing on one writer.
+//
+//   lmdbmap::sharded_map<int, std::string> m("db", 8);
+//   m.put_many(batch);                        // one writer per shard
+//   m.transact(m.shard_of(k), [&](lmdbmap::transaction& txn, auto& shard) {
+//       shard.put(txn, k, "v");               // shard-local transaction
+//   });
+//   m.for_each([](const auto& entry) { ... });  // merged in key order
+//
+// There are no transactions across shards: put_many and erase_many commit
+// every shard separately, and reads of several shards see each shard's
+// latest snapshot. The shard count is stored in every shard and checked
+// when the map is opened again, since keys are routed by it.
+//
+// Like parallel_for_each, the methods that read or write several shards
+// must not be called while this thread has a transaction open on a shard.
+// Batches are spread over shard_count() - 1 worker threads kept for the
+// lifetime of the map, plus the calling thread.
+template<typename Key, typename T, typename KeyCodec = key_codec<Key>, typename ValueCodec = value_codec<T>>
+class sharded_map {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<Key, T>;
+    using key_codec_type = KeyCodec;
+    using value_codec_type = ValueCodec;
+    using shard_type = map<Key, T, KeyCodec, ValueCodec>;
+
+    sharded_map(const std::string& path, size_t shards, const std::string& name = "data",
+                const environment_options& options = environment_options()) {
+        if (shards == 0) throw std::invalid_argument("lmdbmap: sharded_map needs at least one shard");
+        for (size_t i = 0; i < shards; ++i) {
+            std::string shard_dir = detail::shard_path(path, i);
+            envs_.push_back(std::make_unique<environment>(shard_dir, options));
+            check_layout(*envs_.back(), shard_dir, i, shards);
+            shards_.push_back(std::make_unique<shard_type>(*envs_.back(), name));
+        }
+        if (shards > 1) workers_ = std::make_unique<detail::io_pool>(shards - 1);
+    }
+
+    size_t shard_count() const { return shards_.size(); }
+
+    size_t shard_of(const Key& key) const {
+        auto k = KeyCodec::encode(key);
+        return static_cast<size_t>(detail::shard_hash(k.data(), k.size()) % shards_.size());
+    }
+
+    environment& env(size_t shard) { return *envs_[shard]; }
+    shard_type& shard(size_t shard) { return *shards_[shard]; }
+
+    // Runs fn(txn, shard) in a write transaction on one shard, growing its
+    // map if it fills up (see lmdbmap::transact). Only keys with
+    // shard_of(key) == shard belong in it.
+    template<typename F>
+    auto transact(size_t shard, F&& fn) {
+        shard_type& m = *shards_[shard];
+        return lmdbmap::transact(*envs_[shard], [&](transaction& txn) { return fn(txn, m); });
+    }
+
+    void put(const Key& key, const T& value) {
+        transact(shard_of(key), [&](transaction& txn, shard_type& m) { m.put(txn, key, value); });
+    }
+
+    bool insert(const Key& key, const T& value) {
+        return transact(shard_of(key), [&](transaction& txn, shard_type& m) { return m.insert(txn, key, value); });
+    }
+
+    void erase(const Key& key) {
+        transact(shard_of(key), [&](transaction& txn, shard_type& m) { m.erase(txn, key); });
+    }
+
+    std::optional<T> get(const Key& key) {
+        size_t s = shard_of(key);
+        read_txn txn(*envs_[s]);
+        return shards_[s]->get(txn, key);
+    }
+
+    // Writes entries with one transaction per shard, the shards in parallel.
+    // Each shard commits on its own: if one fails, the others may already
+    // have committed.
+    void put_many(const std::vector<value_type>& entries) {
+        std::vector<std::vector<const value_type*>> parts(shards_.size());
+        for (const value_type& e : entries) parts[shard_of(e.first)].push_back(&e);
+        fan_out(parts, [&](size_t s, const std::vector<const value_type*>& part) {
+            transact(s, [&](transaction& txn, shard_type& m) {
+                for (const value_type* e : part) m.put(txn, e->first, e->second);
+            });
+        });
+    }
+
+    void erase_many(const std::vector<Key>& keys) {
+        std::vector<std::vector<const Key*>> parts(shards_.size());
+        for (const Key& k : keys) parts[shard_of(k)].push_back(&k);
+        fan_out(parts, [&](size_t s, const std::vector<const Key*>& part) {
+            transact(s, [&](transaction& txn, shard_type& m) {
+                for (const Key* k : part) m.erase(txn, *k);
+            });
+        });
+    }
+
+    // Looks up keys on all shards in parallel, with map::get_many on each,
+    // and returns the results in input order.
+    std::vector<std::optional<T>> get_many(const std::vector<Key>& keys) {
+        std::vector<std::vector<size_t>> parts(shards_.size());
+        for (size_t i = 0; i < keys.size(); ++i) parts[shard_of(keys[i])].push_back(i);
+        std::vector<std::optional<T>> results(keys.size());
+        fan_out(parts, [&](size_t s, const std::vector<size_t>& part) {
+            std::vector<Key> shard_keys;
+            shard_keys.reserve(part.size());
+            for (size_t i : part) shard_keys.push_back(keys[i]);
+            transaction txn(*envs_[s], true);
+            std::vector<std::optional<T>> found = shards_[s]->get_many(txn, shard_keys);
+            for (size_t j = 0; j < part.size(); ++j) results[part[j]] = std::move(found[j]);
+        });
+        return results;
+    }
+
+    // Number of entries over all shards, each from its own snapshot.
+    size_t size() {
+        size_t n = 0;
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            read_txn txn(*envs_[s]);
+            n += shards_[s]->size(txn);
+        }
+        return n;
+    }
+
+    // Calls fn(entry) for every entry in key order. Every shard is read and
+    // decoded by its own thread in a read-only transaction; this thread
+    // merges their output by encoded key and runs fn.
+    template<typename F>
+    void for_each(F fn) {
+        merge_scan(nullptr, nullptr, fn);
+    }
+
+    // for_each over the entries with lo <= key < hi.
+    template<typename F>
+    void for_each(const Key& lo, const Key& hi, F fn) {
+        auto lo_bytes = KeyCodec::encode(lo);
+        auto hi_bytes = KeyCodec::encode(hi);
+        std::string from(lo_bytes.data(), lo_bytes.size());
+        std::string to(hi_bytes.data(), hi_bytes.size());
+        merge_scan(&from, &to, fn);
+    }
+
+private:
+    std::vector<std::unique_ptr<environment>> envs_;
+    std::vector<std::unique_ptr<shard_type>> shards_;
+    std::unique_ptr<detail::io_pool> workers_;
+
+    // Records the layout in a new shard, or checks it against the stored
+    // one. Only a new shard needs a write transaction, so shards opened
+    // with MDB_RDONLY work once they exist.
+    static void check_layout(environment& env, const std::string& dir, size_t shard, size_t shards) {
+        map<std::string, std::uint32_t> meta(env, "lmdbmap.shards");
+        std::optional<std::uint32_t> count;
+        std::optional<std::uint32_t> index;
+        {
+            read_txn txn(env);
+            count = meta.get(txn, "count");
+            index = meta.get(txn, "index");
+        }
+        if (!count) {
+            lmdbmap::transact(env, [&](transaction& txn) {
+                meta.put(txn, "count", static_cast<std::uint32_t>(shards));
+                meta.put(txn, "index", static_cast<std::uint32_t>(shard));
+            });
+            return;
+        }
+        if (*count != shards) {
+            throw std::runtime_error("lmdbmap: sharded_map opened with " + std::to_string(shards) +
+                                     " shards, but it was created with " + std::to_string(*count));
+        }
+        if (index != static_cast<std::uint32_t>(shard)) {
+            throw std::runtime_error("lmdbmap: " + dir + " holds shard " +
+                                     (index ? std::to_string(*index) : std::string("?")) +
+                                     ", not shard " + std::to_string(shard) +
+                                     "; were shard directories renamed or swapped?");
+        }
+    }
+
+    // Runs fn(s, parts[s]) for every non-empty part, the first on this
+    // thread and the others on the workers, and rethrows the first
+    // exception once all of them are done.
+    template<typename Part, typename F>
+    void fan_out(const std::vector<Part>& parts, F fn) {
+        std::vector<size_t> busy;
+        for (size_t s = 0; s < parts.size(); ++s) {
+            if (!parts[s].empty()) busy.push_back(s);
+        }
+        if (busy.empty()) return;
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t pending = busy.size() - 1;
+        std::exception_ptr error;
+        auto work = [&](size_t s) {
+            std::exception_ptr failed;
+            try {
+                fn(s, parts[s]);
+            } catch (...) {
+                failed = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (failed && !error) error = failed;
+        };
+        for (size_t i = 1; i < busy.size(); ++i) {
+            workers_->post([&, s = busy[i]] {
+                work(s);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) finished.notify_all();
+            });
+        }
+        work(busy[0]);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return pending == 0; });
+        if (error) std::rethrow_exception(error);
+    }
+
+    struct scanned {
+        std::string key_bytes;
+        value_type entry;
+    };
+
+    // Decoded entries of one shard, handed from its scanning thread to the
+    // merge in chunks, at most max_chunks of them queued.
+    struct feed {
+        static constexpr size_t chunk_size = 256;
+        static constexpr size_t max_chunks = 4;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::vector<scanned>> chunks;
+        bool done = false;
+        std::exception_ptr error;
+
+        std::vector<scanned> current;
+        size_t pos = 0;
+    };
+
+    template<typename F>
+    void merge_scan(const std::string* lo, const std::string* hi, F& fn) {
+        size_t n = shards_.size();
+        std::vector<feed> feeds(n);
+        std::atomic<bool> stop{false};
+        struct stopped {};
+
+        auto produce = [&](size_t s) {
+            feed& f = feeds[s];
+            auto push = [&](std::vector<scanned>& chunk) {
+                std::unique_lock<std::mutex> lock(f.mutex);
+                f.changed.wait(lock, [&] { return stop || f.chunks.size() < feed::max_chunks; });
+                if (stop) throw stopped{};
+                f.chunks.push_back(std::move(chunk));
+                chunk.clear();
+                f.changed.notify_all();
+            };
+            try {
+                transaction txn(*envs_[s], true);
+                MDB_cursor* cursor = txn.acquire_cursor(shards_[s]->dbi());
+                std::vector<scanned> chunk;
+                try {
+                    detail::scan_partition(cursor, lo, hi, [&](const MDB_val& k, const MDB_val& v) {
+                        chunk.push_back(scanned{detail::bytes_of(k),
+                                                value_type(KeyCodec::decode(k.mv_data, k.mv_size),
+                                                           ValueCodec::decode(v.mv_data, v.mv_size))});
+                        if (chunk.size() == feed::chunk_size) push(chunk);
+                    });
+                    if (!chunk.empty()) push(chunk);
+                } catch (...) {
+                    txn.release_cursor(cursor);
+                    throw;
+                }
+                txn.release_cursor(cursor);
+            } catch (const stopped&) {
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(f.mutex);
+                f.error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(f.mutex);
+            f.done = true;
+            f.changed.notify_all();
+        };
+
+        // Makes the next entry of shard s current; false once it is drained.
+        auto advance = [&](size_t s) {
+            feed& f = feeds[s];
+            if (++f.pos < f.current.size()) return true;
+            std::unique_lock<std::mutex> lock(f.mutex);
+            f.changed.wait(lock, [&] { return f.done || !f.chunks.empty(); });
+            if (f.error) std::rethrow_exception(f.error);
+            if (f.chunks.empty()) return false;
+            f.current = std::move(f.chunks.front());
+            f.chunks.pop_front();
+            f.pos = 0;
+            f.changed.notify_all();
+            return true;
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t s = 0; s < n; ++s) threads.emplace_back(produce, s);
+        auto finish = [&] {
+            stop = true;
+            for (feed& f : feeds) {
+                std::lock_guard<std::mutex> lock(f.mutex);
+                f.changed.notify_all();
+            }
+            for (auto& t : threads) t.join();
+        };
+
+        try {
+            auto later = [&](size_t a, size_t b) {
+                return feeds[a].current[feeds[a].pos].key_bytes > feeds[b].current[feeds[b].pos].key_bytes;
+            };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heads(later);
+            for (size_t s = 0; s < n; ++s) {
+                if (advance(s)) heads.push(s);
+            }
+            while (!heads.empty()) {
+                size_t s = heads.top();
+                heads.pop();
+                const value_type& entry = feeds[s].current[feeds[s].pos].entry;
+                fn(entry);
+                if (advance(s)) heads.push(s);
+            }
+        } catch (...) {
+            finish();
+            throw;
+        }
+        finish();
+    }
+};
+
+}
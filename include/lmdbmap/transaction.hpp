@@ -1,38 +1,254 @@
 #pragma once
 #include <lmdb.h>
 #include <stdexcept>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "environment.hpp"
+#include "error.hpp"
+
+// Track transaction lifetime so byte_view can detect use after the
+// transaction ended. On by default in debug builds.
+#ifndef LMDBMAP_CHECK_VIEWS
+#ifdef NDEBUG
+#define LMDBMAP_CHECK_VIEWS 0
+#else
+#define LMDBMAP_CHECK_VIEWS 1
+#endif
+#endif
 
 namespace lmdbmap {
 
+namespace detail {
+
+struct unguarded_t {};
+
+}
+
 class transaction {
 public:
-    transaction(environment& env, bool read_only = false) {
+    transaction(environment& env, bool read_only = false) : read_only_(read_only) {
+#if LMDBMAP_METRICS
+        uint64_t requested = detail::now_ns();
+#endif
+        for (;;) {
+            env.gate().enter();
+            int rc = mdb_txn_begin(env, nullptr, read_only ? MDB_RDONLY : 0, &txn_);
+            if (rc == 0) break;
+            env.gate().leave();
+            if (rc != MDB_MAP_RESIZED) detail::throw_error(rc);
+            env.adopt_map_size();
+        }
+        gate_ = &env.gate();
+#if LMDBMAP_METRICS
+        began(env, requested);
+#endif
+    }
+
+    // For transactions whose caller already holds env.gate() on their
+    // behalf, such as the workers of a parallel scan.
+    transaction(environment& env, bool read_only, detail::unguarded_t) : read_only_(read_only) {
+#if LMDBMAP_METRICS
+        uint64_t requested = detail::now_ns();
+#endif
         int rc = mdb_txn_begin(env, nullptr, read_only ? MDB_RDONLY : 0, &txn_);
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        if (rc != 0) detail::throw_error(rc);
+#if LMDBMAP_METRICS
+        began(env, requested);
+#endif
     }
 
+    transaction(const transaction&) = delete;
+    transaction& operator=(const transaction&) = delete;
+
     ~transaction() {
-        if (txn_) mdb_txn_abort(txn_);
+        abort();
     }
 
     void commit() {
         if (!txn_) return;
+        if (reader_) {
+            release_reader();
+            return;
+        }
+        close_cursors();
         int rc = mdb_txn_commit(txn_);
         txn_ = nullptr;
-        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+#if LMDBMAP_METRICS
+        if (rc == 0 && !read_only_) metrics_->commits.add(1);
+#endif
+        end();
+        if (rc != 0) detail::throw_error(rc);
     }
 
     void abort() {
         if (!txn_) return;
+        if (reader_) {
+            release_reader();
+            return;
+        }
+        close_cursors();
         mdb_txn_abort(txn_);
         txn_ = nullptr;
+#if LMDBMAP_METRICS
+        if (!read_only_) metrics_->aborts.add(1);
+#endif
+        end();
     }
 
     operator MDB_txn*() const { return txn_; }
 
+    bool read_only() const { return read_only_; }
+
+    // Cursors are pooled per transaction: iterators and lookups take one with
+    // acquire_cursor() and hand it back with release_cursor(), so a loop of
+    // lookups opens at most one cursor per dbi.
+    MDB_cursor* acquire_cursor(MDB_dbi dbi) {
+        for (size_t i = 0; i < cursors_.size(); ++i) {
+            if (mdb_cursor_dbi(cursors_[i]) == dbi) {
+                MDB_cursor* cursor = cursors_[i];
+                cursors_[i] = cursors_.back();
+                cursors_.pop_back();
+                return cursor;
+            }
+        }
+        MDB_cursor* cursor;
+        int rc = mdb_cursor_open(txn_, dbi, &cursor);
+        if (rc != 0) throw std::runtime_error(mdb_strerror(rc));
+        return cursor;
+    }
+
+    void release_cursor(MDB_cursor* cursor) {
+        if (txn_) {
+            cursors_.push_back(cursor);
+        } else if (read_only_) {
+            // LMDB frees write cursors with their transaction, read cursors
+            // must always be closed explicitly.
+            mdb_cursor_close(cursor);
+        }
+    }
+
+#if LMDBMAP_CHECK_VIEWS
+    std::weak_ptr<char> liveness() const { return alive_; }
+#endif
+
+protected:
+    // Borrows a recycled read-only transaction from env's reader pool; it is
+    // reset and handed back, cursors included, when this transaction ends.
+    struct pooled_tag {};
+    transaction(environment& env, pooled_tag) : read_only_(true), pool_(&env.readers()) {
+#if LMDBMAP_METRICS
+        uint64_t requested = detail::now_ns();
+#endif
+        for (;;) {
+            env.gate().enter();
+            try {
+                reader_ = pool_->acquire();
+                break;
+            } catch (const map_resized_error&) {
+                env.gate().leave();
+                env.adopt_map_size();
+            } catch (...) {
+                env.gate().leave();
+                throw;
+            }
+        }
+        gate_ = &env.gate();
+        txn_ = reader_->txn;
+        cursors_.swap(reader_->cursors);
+#if LMDBMAP_METRICS
+        began(env, requested);
+#endif
+    }
+
 private:
     MDB_txn* txn_ = nullptr;
+    bool read_only_ = false;
+    std::vector<MDB_cursor*> cursors_;
+    detail::reader_pool* pool_ = nullptr;
+    detail::pooled_reader* reader_ = nullptr;
+    detail::resize_gate* gate_ = nullptr;
+#if LMDBMAP_CHECK_VIEWS
+    std::shared_ptr<char> alive_ = std::make_shared<char>();
+#endif
+#if LMDBMAP_METRICS
+    environment_metrics* metrics_ = nullptr;
+    uint64_t began_ = 0;
+
+    void began(environment& env, uint64_t requested) {
+        metrics_ = &env.metrics();
+        began_ = detail::now_ns();
+        if (read_only_) {
+            metrics_->read_txns.add(1);
+        } else {
+            metrics_->write_txns.add(1);
+            metrics_->write_wait.record(began_ - requested);
+        }
+    }
+#endif
+
+    void release_reader() {
+        reader_->cursors.swap(cursors_);
+        pool_->release(reader_);
+        reader_ = nullptr;
+        txn_ = nullptr;
+        end();
+    }
+
+    void close_cursors() {
+        for (MDB_cursor* cursor : cursors_) mdb_cursor_close(cursor);
+        cursors_.clear();
+    }
+
+    // Runs however the transaction ends: invalidates views and lets the map
+    // be resized again.
+    void end() {
+#if LMDBMAP_CHECK_VIEWS
+        alive_.reset();
+#endif
+#if LMDBMAP_METRICS
+        histogram& duration = read_only_ ? metrics_->read_txn_duration : metrics_->write_txn_duration;
+        duration.record(detail::now_ns() - began_);
+#endif
+        if (gate_) {
+            gate_->leave();
+            gate_ = nullptr;
+        }
+    }
+};
+
+// Cheap read-only transaction for short reads. Instead of mdb_txn_begin and
+// mdb_txn_abort it renews and resets a transaction kept by the environment,
+// one per thread (or shared between threads with MDB_NOTLS).
+class read_txn : public transaction {
+public:
+    explicit read_txn(environment& env) : transaction(env, pooled_tag{}) {}
 };
 
+// Runs fn(txn) in a write transaction and commits it, returning fn's result.
+// If the map fills up, the transaction is rolled back, the map grown and fn
+// run again from the start, so fn should only change the database. Must not
+// be called while this thread has another transaction open.
+template<typename F>
+auto transact(environment& env, F&& fn) -> std::invoke_result_t<F&, transaction&> {
+    for (;;) {
+        size_t seen = env.map_size();
+        try {
+            transaction txn(env);
+            if constexpr (std::is_void_v<std::invoke_result_t<F&, transaction&>>) {
+                fn(txn);
+                txn.commit();
+                return;
+            } else {
+                auto result = fn(txn);
+                txn.commit();
+                return result;
+            }
+        } catch (const map_full_error&) {
+            env.grow(seen);
+        }
+    }
+}
+
 }
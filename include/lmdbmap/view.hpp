@@ -0,0 +1,65 @@
+#pragma once
+#include "transaction.hpp"
+#include <lmdb.h>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+namespace lmdbmap {
+
+// Non-owning view of bytes inside LMDB's memory map. It stays valid until
+// the transaction it was read in commits or aborts, or until the next write
+// in that transaction. With LMDBMAP_CHECK_VIEWS enabled, accessing the bytes
+// of a view whose transaction has ended throws std::logic_error.
+class byte_view {
+public:
+    byte_view() = default;
+
+    byte_view(const MDB_val& val, const transaction& txn)
+        : data_(static_cast<const char*>(val.mv_data)), size_(val.mv_size) {
+#if LMDBMAP_CHECK_VIEWS
+        alive_ = txn.liveness();
+#else
+        (void)txn;
+#endif
+    }
+
+    const char* data() const { check(); return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    std::string_view str() const { check(); return std::string_view(data_, size_); }
+    operator std::string_view() const { return str(); }
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+    std::span<const std::byte> bytes() const {
+        check();
+        return std::span<const std::byte>(reinterpret_cast<const std::byte*>(data_), size_);
+    }
+#endif
+
+    template<typename Codec>
+    auto decode() const {
+        check();
+        return Codec::decode(data_, size_);
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#if LMDBMAP_CHECK_VIEWS
+    std::weak_ptr<char> alive_;
+#endif
+
+    void check() const {
+#if LMDBMAP_CHECK_VIEWS
+        if (data_ && alive_.expired()) throw std::logic_error("lmdbmap: view used after its transaction ended");
+#endif
+    }
+};
+
+}
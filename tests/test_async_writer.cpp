@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/async_writer.hpp>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/multimap.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <filesystem>
+#include <future>
+#include <thread>
+#include <vector>
+
+class AsyncWriterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_async");
+        env = std::make_unique<lmdbmap::environment>("test_db_async");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_async");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(AsyncWriterTest, ConcurrentProducers) {
+    lmdbmap::map<int, int> m(*env, "async_map");
+    std::atomic<int> commits{0};
+    {
+        lmdbmap::async_writer_options options;
+        options.max_batch = 64;
+        lmdbmap::async_writer writer(*env, options);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t] {
+                std::vector<std::future<void>> done;
+                for (int i = 0; i < 250; ++i) done.push_back(writer.put(m, t * 1000 + i, i));
+                for (auto& f : done) f.get();
+            });
+        }
+        for (auto& thread : threads) thread.join();
+
+        // Completed futures mean the data is committed.
+        lmdbmap::transaction txn(*env, true);
+        EXPECT_EQ(m.get(txn, 3249), 249);
+        EXPECT_EQ(m.get(txn, 0), 0);
+    }
+    lmdbmap::transaction txn(*env, true);
+    int count = 0;
+    for (const auto& kv : m.range(txn)) {
+        EXPECT_EQ(kv.second, kv.first % 1000);
+        ++count;
+    }
+    EXPECT_EQ(count, 1000);
+}
+
+TEST_F(AsyncWriterTest, EraseAndSubmit) {
+    lmdbmap::map<int, std::string> m(*env, "async_erase");
+    lmdbmap::multimap<int, int> mm(*env, "async_multimap");
+    lmdbmap::async_writer writer(*env);
+    writer.put(m, 1, "one").get();
+    writer.put(m, 2, "two").get();
+    writer.put(mm, 1, 10);
+    writer.put(mm, 1, 11);
+    writer.erase(mm, 1, 10);
+    writer.erase(m, 1).get();
+
+    auto size = writer.submit([&](lmdbmap::transaction& txn) {
+        m.put(txn, 3, "three");
+        return m.get(txn, 2).value();
+    });
+    EXPECT_EQ(size.get(), "two");
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_FALSE(m.get(txn, 1).has_value());
+    EXPECT_EQ(m.get(txn, 3), "three");
+    EXPECT_EQ(mm.get(txn, 1), std::vector<int>{11});
+}
+
+TEST_F(AsyncWriterTest, FailedOperationDoesNotLoseBatch) {
+    lmdbmap::map<int, int> m(*env, "async_fail");
+    std::vector<std::future<void>> done;
+    std::future<void> failing;
+    {
+        lmdbmap::async_writer_options options;
+        options.max_latency = std::chrono::milliseconds(50);
+        lmdbmap::async_writer writer(*env, options);
+        for (int i = 0; i < 10; ++i) {
+            if (i == 5) {
+                failing = writer.submit([&](lmdbmap::transaction& txn) {
+                    m.put(txn, -1, -1);
+                    throw std::runtime_error("rejected");
+                });
+            }
+            done.push_back(writer.put(m, i, i));
+        }
+    }
+    EXPECT_THROW(failing.get(), std::runtime_error);
+    for (auto& f : done) EXPECT_NO_THROW(f.get());
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_FALSE(m.get(txn, -1).has_value());
+    for (int i = 0; i < 10; ++i) EXPECT_EQ(m.get(txn, i), i);
+}
+
+TEST_F(AsyncWriterTest, PostCallsDone) {
+    lmdbmap::map<int, int> m(*env, "async_post");
+    std::promise<std::exception_ptr> ok, failed;
+    {
+        lmdbmap::async_writer writer(*env);
+        writer.post([&](lmdbmap::transaction& txn) { m.put(txn, 1, 1); },
+                    [&](std::exception_ptr error) { ok.set_value(error); });
+        writer.post([&](lmdbmap::transaction& txn) {
+                        m.put(txn, 2, 2);
+                        throw std::runtime_error("rejected");
+                    },
+                    [&](std::exception_ptr error) { failed.set_value(error); });
+    }
+    EXPECT_EQ(ok.get_future().get(), nullptr);
+    EXPECT_NE(failed.get_future().get(), nullptr);
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.get(txn, 1), 1);
+    EXPECT_FALSE(m.get(txn, 2).has_value());
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/blob_map.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string pattern(size_t size) {
+    std::string out(size, '\0');
+    for (size_t i = 0; i < size; ++i) out[i] = static_cast<char>('a' + (i * 7 + i / 13) % 26);
+    return out;
+}
+
+}
+
+class BlobMapTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_blob");
+        env = std::make_unique<lmdbmap::environment>("test_db_blob");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_blob");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(BlobMapTest, ChunkedWritesAndRangeReads) {
+    lmdbmap::blob_map<std::string> blobs(*env, "blobs", 1000);
+    std::string data = pattern(10500);
+    {
+        lmdbmap::transaction txn(*env);
+        lmdbmap::blob_map<std::string>::writer w(blobs, txn, "big");
+        w.write(data.substr(0, 10));
+        w.write(data.substr(10, 2500));
+        w.write(data.substr(2510));
+        EXPECT_EQ(w.close(), data.size());
+        blobs.put(txn, "bi", "neighbour");
+        blobs.put(txn, std::string("big\0", 4), "also a neighbour");
+        blobs.put(txn, "empty", "");
+        txn.commit();
+    }
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(blobs.size(txn, "big"), data.size());
+    EXPECT_EQ(blobs.stat(txn, "big")->chunk_size, 1000u);
+    EXPECT_EQ(blobs.get(txn, "big"), data);
+    EXPECT_EQ(blobs.get(txn, "bi"), "neighbour");
+    EXPECT_EQ(blobs.get(txn, "empty"), "");
+    EXPECT_EQ(blobs.get(txn, "missing"), std::nullopt);
+
+    std::vector<size_t> sizes;
+    std::string joined;
+    for (const auto& chunk : blobs.chunks(txn, "big", 1500, 2000)) {
+        sizes.push_back(chunk.size());
+        joined += chunk.str();
+    }
+    EXPECT_EQ(sizes, (std::vector<size_t>{500, 1000, 500}));
+    EXPECT_EQ(joined, data.substr(1500, 2000));
+
+    std::string buf(800, '\0');
+    EXPECT_EQ(blobs.read(txn, "big", 10000, &buf[0], buf.size()), 500u);
+    EXPECT_EQ(buf.substr(0, 500), data.substr(10000));
+    EXPECT_EQ(blobs.read(txn, "big", 20000, &buf[0], buf.size()), 0u);
+    EXPECT_EQ(blobs.read(txn, "missing", 0, &buf[0], buf.size()), 0u);
+}
+
+TEST_F(BlobMapTest, StreamsAndReplace) {
+    lmdbmap::blob_map<int> blobs(*env, "streams", 256);
+    std::string data = pattern(5000);
+    {
+        lmdbmap::transaction txn(*env);
+        std::istringstream in(pattern(9000));
+        blobs.put(txn, 1, in);
+        std::istringstream replacement(data);
+        blobs.put(txn, 1, replacement);
+        blobs.put(txn, 2, "two");
+        txn.commit();
+    }
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(blobs.size(txn, 1), data.size());
+    lmdbmap::blob_map<int>::istream in(blobs, txn, 1);
+    std::string all((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(all, data);
+
+    in.clear();
+    in.seekg(4000);
+    std::string part(300, '\0');
+    in.read(&part[0], 300);
+    EXPECT_EQ(part, data.substr(4000, 300));
+    in.seekg(-10, std::ios::cur);
+    EXPECT_EQ(in.tellg(), 4290);
+    EXPECT_EQ(in.get(), data[4290]);
+    in.seekg(-1, std::ios::end);
+    EXPECT_EQ(in.get(), data.back());
+    EXPECT_EQ(in.get(), std::char_traits<char>::eof());
+
+    lmdbmap::blob_map<int>::istream missing(blobs, txn, 3);
+    EXPECT_TRUE(missing.fail());
+}
+
+TEST_F(BlobMapTest, Erase) {
+    lmdbmap::blob_map<int> blobs(*env, "erase", 100);
+    lmdbmap::transaction txn(*env);
+    blobs.put(txn, 1, pattern(1000));
+    blobs.put(txn, 2, pattern(50));
+    EXPECT_TRUE(blobs.erase(txn, 1));
+    EXPECT_FALSE(blobs.erase(txn, 1));
+    EXPECT_EQ(blobs.get(txn, 1), std::nullopt);
+    EXPECT_EQ(blobs.get(txn, 2), pattern(50));
+
+    MDB_stat stat;
+    ASSERT_EQ(mdb_stat(txn, blobs.dbi(), &stat), 0);
+    EXPECT_EQ(stat.ms_entries, 2u);
+}
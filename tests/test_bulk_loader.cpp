@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/bulk_loader.hpp>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/multimap.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <utility>
+#include <vector>
+
+class BulkLoaderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_bulk");
+        std::filesystem::remove_all("test_db_bulk_runs");
+        std::filesystem::create_directories("test_db_bulk_runs");
+        env = std::make_unique<lmdbmap::environment>("test_db_bulk");
+        options.temp_dir = "test_db_bulk_runs";
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_bulk");
+        std::filesystem::remove_all("test_db_bulk_runs");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+    lmdbmap::bulk_load_options options;
+};
+
+TEST_F(BulkLoaderTest, LoadsUnsortedInputWithSpills) {
+    lmdbmap::map<int, int> m(*env, "bulk_map");
+    std::vector<std::pair<int, int>> input;
+    for (int i = -500; i < 500; ++i) input.emplace_back(i, i * 2);
+    std::shuffle(input.begin(), input.end(), std::mt19937(42));
+    input.emplace_back(7, 700);  // later value wins
+
+    options.memory_limit = 4096;
+    options.commit_every = 128;
+    lmdbmap::bulk_loader<lmdbmap::map<int, int>> loader(*env, m, options);
+    loader.add(input);
+    EXPECT_FALSE(std::filesystem::is_empty("test_db_bulk_runs"));
+    EXPECT_EQ(loader.finish(), 1000u);
+    EXPECT_TRUE(std::filesystem::is_empty("test_db_bulk_runs"));
+
+    lmdbmap::transaction txn(*env, true);
+    int expected = -500;
+    for (const auto& kv : m.range(txn)) {
+        EXPECT_EQ(kv.first, expected);
+        EXPECT_EQ(kv.second, expected == 7 ? 700 : expected * 2);
+        ++expected;
+    }
+    EXPECT_EQ(expected, 500);
+}
+
+TEST_F(BulkLoaderTest, LoadsIntoExistingData) {
+    lmdbmap::map<int, int> m(*env, "bulk_existing");
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 5, 0);
+        m.put(txn, 50, 0);
+        txn.commit();
+    }
+    lmdbmap::bulk_loader<lmdbmap::map<int, int>> loader(*env, m, options);
+    for (int i = 0; i < 100; i += 10) loader.add(i, i);
+    EXPECT_EQ(loader.finish(), 10u);
+
+    lmdbmap::transaction txn(*env, true);
+    std::vector<int> keys;
+    for (int k : m.keys(txn)) keys.push_back(k);
+    EXPECT_EQ(keys, (std::vector<int>{0, 5, 10, 20, 30, 40, 50, 60, 70, 80, 90}));
+    EXPECT_EQ(m.get(txn, 50), 50);
+}
+
+TEST_F(BulkLoaderTest, LoadsMultimap) {
+    lmdbmap::multimap<std::string, std::string> m(*env, "bulk_multimap");
+    options.memory_limit = 256;
+    lmdbmap::bulk_loader<lmdbmap::multimap<std::string, std::string>> loader(*env, m, options);
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 9; i >= 0; --i) {
+            loader.add("k" + std::to_string(i % 3), "v" + std::to_string(i));
+        }
+    }
+    EXPECT_EQ(loader.finish(), 10u);
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.get(txn, "k0"), (std::vector<std::string>{"v0", "v3", "v6", "v9"}));
+    EXPECT_EQ(m.get(txn, "k1"), (std::vector<std::string>{"v1", "v4", "v7"}));
+    EXPECT_EQ(m.get(txn, "k2"), (std::vector<std::string>{"v2", "v5", "v8"}));
+}
+
+TEST_F(BulkLoaderTest, LoadersKeepRunsApart) {
+    lmdbmap::map<int, int> a(*env, "bulk_a");
+    lmdbmap::map<int, int> b(*env, "bulk_b");
+    options.memory_limit = 1024;
+    lmdbmap::bulk_loader<lmdbmap::map<int, int>> load_a(*env, a, options);
+    lmdbmap::bulk_loader<lmdbmap::map<int, int>> load_b(*env, b, options);
+    for (int i = 0; i < 300; ++i) {
+        load_a.add(i, 1);
+        load_b.add(i, 2);
+    }
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator("test_db_bulk_runs"),
+                            std::filesystem::directory_iterator()), 2);
+    EXPECT_EQ(load_a.finish(), 300u);
+    EXPECT_EQ(load_b.finish(), 300u);
+    EXPECT_TRUE(std::filesystem::is_empty("test_db_bulk_runs"));
+
+    lmdbmap::transaction txn(*env, true);
+    for (int v : a.values(txn)) EXPECT_EQ(v, 1);
+    for (int v : b.values(txn)) EXPECT_EQ(v, 2);
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/cache.hpp>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int value_decodes = 0;
+
+struct counting_codec {
+    static std::string_view encode(const std::string& v) { return v; }
+    static std::string decode(const void* data, size_t size) {
+        ++value_decodes;
+        return std::string(static_cast<const char*>(data), size);
+    }
+};
+
+using counted_map = lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, counting_codec>;
+
+}
+
+class CacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_cache");
+        env = std::make_unique<lmdbmap::environment>("test_db_cache", lmdbmap::environment_options().no_tls());
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_cache");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(CacheTest, HitsSkipDecoding) {
+    counted_map m(*env, "cache_hits");
+    lmdbmap::cached_map<counted_map> cache(m);
+    {
+        lmdbmap::transaction txn(*env);
+        cache.put(txn, 1, "one");
+        txn.commit();
+    }
+
+    value_decodes = 0;
+    for (int i = 0; i < 3; ++i) {
+        lmdbmap::read_txn txn(*env);
+        EXPECT_EQ(cache.get(txn, 1), "one");
+        EXPECT_EQ(cache.get(txn, 2), std::nullopt);
+    }
+    EXPECT_EQ(value_decodes, 1);
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 4u);
+    EXPECT_EQ(stats.entries, 1u);
+}
+
+TEST_F(CacheTest, WritesInvalidateBySnapshot) {
+    counted_map m(*env, "cache_invalidate");
+    lmdbmap::cached_map<counted_map> cache(m);
+    {
+        lmdbmap::transaction txn(*env);
+        cache.put(txn, 1, "a");
+        txn.commit();
+    }
+
+    lmdbmap::transaction old_reader(*env, true);
+    EXPECT_EQ(cache.get(old_reader, 1), "a");
+    {
+        lmdbmap::transaction txn(*env);
+        cache.put(txn, 1, "b");
+        EXPECT_EQ(cache.get(txn, 1), "b");
+        txn.commit();
+    }
+
+    // The old snapshot still reads "a" but cannot put it back in the cache.
+    EXPECT_EQ(cache.get(old_reader, 1), "a");
+    {
+        lmdbmap::transaction reader(*env, true);
+        EXPECT_EQ(cache.get(reader, 1), "b");
+        EXPECT_EQ(cache.get(reader, 1), "b");
+    }
+    EXPECT_EQ(cache.get(old_reader, 1), "a");
+    old_reader.abort();
+
+    {
+        lmdbmap::transaction txn(*env);
+        cache.erase(txn, 1);
+        cache.put(txn, 2, "lost");
+    }
+    lmdbmap::read_txn reader(*env);
+    EXPECT_EQ(cache.get(reader, 1), "b");
+    EXPECT_EQ(cache.get(reader, 2), std::nullopt);
+}
+
+TEST_F(CacheTest, EvictionKeepsWithinBudget) {
+    counted_map m(*env, "cache_evict");
+    lmdbmap::cache_options options;
+    options.max_bytes = 4096;
+    options.shards = 2;
+    lmdbmap::cached_map<counted_map> cache(m, options);
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 500; ++i) cache.put(txn, i, std::string(16, 'x'));
+        txn.commit();
+    }
+
+    lmdbmap::read_txn txn(*env);
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 500; ++i) {
+            EXPECT_EQ(cache.get(txn, i), std::string(16, 'x'));
+            // A hot key keeps being referenced and survives the sweep.
+            EXPECT_EQ(cache.get(txn, 7), std::string(16, 'x'));
+        }
+    }
+    auto stats = cache.stats();
+    EXPECT_LE(stats.bytes, options.max_bytes);
+    EXPECT_GT(stats.entries, 0u);
+    EXPECT_LT(stats.entries, 500u);
+    EXPECT_GT(stats.hits, 990u);
+}
+
+TEST_F(CacheTest, ConcurrentReadersSeeConsistentSnapshots) {
+    lmdbmap::map<int, int> m(*env, "cache_concurrent");
+    lmdbmap::cached_map<lmdbmap::map<int, int>> cache(m);
+    const int keys = 32;
+    {
+        lmdbmap::transaction txn(*env);
+        for (int k = 0; k < keys; ++k) cache.put(txn, k, 0);
+        txn.commit();
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            while (!done) {
+                lmdbmap::read_txn txn(*env);
+                auto first = cache.get(txn, 0);
+                for (int k = 1; k < keys; ++k) {
+                    if (cache.get(txn, k) != first) ++mismatches;
+                }
+            }
+        });
+    }
+    for (int round = 1; round <= 200; ++round) {
+        lmdbmap::transaction txn(*env);
+        for (int k = 0; k < keys; ++k) cache.put(txn, k, round);
+        txn.commit();
+    }
+    done = true;
+    for (auto& t : readers) t.join();
+    EXPECT_EQ(mismatches, 0);
+
+    lmdbmap::read_txn txn(*env);
+    for (int k = 0; k < keys; ++k) EXPECT_EQ(cache.get(txn, k), 200);
+}
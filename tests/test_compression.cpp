@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/compression.hpp>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <lmdbmap/sharded_map.hpp>
+#include <filesystem>
+#include <string>
+
+namespace {
+
+template<typename Codec, typename T>
+std::string encoded(const T& obj) {
+    auto bytes = Codec::encode(obj);
+    return std::string(bytes.data(), bytes.size());
+}
+
+#if LMDBMAP_WITH_ZSTD
+std::string record(int i) {
+    return "{\"id\":" + std::to_string(i) + ",\"status\":\"shipped\",\"carrier\":\"ups\",\"country\":\"de\"," +
+           "\"items\":[{\"sku\":\"A-" + std::to_string(i % 97) + "\",\"qty\":" + std::to_string(i % 5) + "}]}";
+}
+#endif
+
+}
+
+class CompressionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_compression");
+        env = std::make_unique<lmdbmap::environment>("test_db_compression");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_compression");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(CompressionTest, ThresholdAndRoundTrip) {
+    using codec = lmdbmap::compressed_codec<std::string>;
+    std::string small = "short";
+    std::string large(4096, 'x');
+
+    std::string e = encoded<codec>(small);
+    EXPECT_EQ(e, std::string(1, '\0') + small);
+    EXPECT_EQ(codec::decode(e.data(), e.size()), small);
+
+    e = encoded<codec>(large);
+    if (lmdbmap::default_compression != lmdbmap::compression::none) EXPECT_LT(e.size(), 200u);
+    EXPECT_EQ(codec::decode(e.data(), e.size()), large);
+    EXPECT_EQ(codec::decompress(e.data(), e.size()), large);
+    EXPECT_THROW(codec::decode("", 0), std::runtime_error);
+
+    // Values that do not shrink are stored as they are.
+    std::string noise;
+    for (unsigned i = 0, x = 1; i < 1024; ++i) noise.push_back(static_cast<char>((x = x * 1103515245u + 12345u) >> 24));
+    EXPECT_EQ(encoded<codec>(noise).size(), noise.size() + 1);
+}
+
+TEST_F(CompressionTest, BoostValuesInMap) {
+    using codec = lmdbmap::compressed_codec<std::vector<std::string>>;
+    lmdbmap::map<int, std::vector<std::string>, lmdbmap::key_codec<int>, codec> m(*env, "boost_values");
+    std::vector<std::string> value(50, "repeated text");
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, value);
+        m.put(txn, 2, {"tiny"});
+        txn.commit();
+    }
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.get(txn, 1), value);
+    EXPECT_EQ(m.get(txn, 2), std::vector<std::string>{"tiny"});
+}
+
+#if LMDBMAP_WITH_LZ4 && LMDBMAP_WITH_ZSTD
+TEST_F(CompressionTest, ReadsEitherAlgorithm) {
+    using lz4 = lmdbmap::compressed_codec<std::string, lmdbmap::compression_config<lmdbmap::compression::lz4>>;
+    using zstd = lmdbmap::compressed_codec<std::string, lmdbmap::compression_config<lmdbmap::compression::zstd>>;
+    std::string value = record(1) + record(2) + record(3);
+    std::string a = encoded<lz4>(value);
+    std::string b = encoded<zstd>(value);
+    EXPECT_EQ(a[0], static_cast<char>(lmdbmap::compression::lz4));
+    EXPECT_EQ(b[0], static_cast<char>(lmdbmap::compression::zstd));
+    EXPECT_EQ(zstd::decode(a.data(), a.size()), value);
+    EXPECT_EQ(lz4::decode(b.data(), b.size()), value);
+}
+#endif
+
+#if LMDBMAP_WITH_LZ4
+TEST_F(CompressionTest, RefusesImpossibleLZ4Sizes) {
+    using codec = lmdbmap::compressed_codec<std::string, lmdbmap::compression_config<lmdbmap::compression::lz4>>;
+    // Claims 4 GiB from 8 bytes of input.
+    std::string corrupt = std::string(1, static_cast<char>(lmdbmap::compression::lz4)) + "\xff\xff\xff\xff" + "12345678";
+    EXPECT_THROW(codec::decode(corrupt.data(), corrupt.size()), std::runtime_error);
+}
+#endif
+
+#if LMDBMAP_WITH_ZSTD
+struct orders_compression : lmdbmap::compression_config<lmdbmap::compression::zstd, 32> {};
+
+TEST_F(CompressionTest, TrainedDictionary) {
+    using codec = lmdbmap::compressed_codec<std::string, orders_compression>;
+    lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, codec> orders(*env, "orders");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 2000; ++i) orders.put(txn, i, record(i));
+        txn.commit();
+    }
+    lmdbmap::detail::encode_target target(*env);
+    size_t plain = encoded<codec>(record(5000)).size();
+
+    unsigned id;
+    {
+        lmdbmap::transaction txn(*env);
+        id = lmdbmap::train_dictionary(txn, orders, "orders", 8 << 10);
+        txn.commit();
+    }
+    EXPECT_NE(id, 0u);
+    {
+        lmdbmap::transaction txn(*env, true);
+        EXPECT_EQ(lmdbmap::load_dictionaries<codec>(txn, "orders"), 1u);
+    }
+    size_t trained = encoded<codec>(record(5000)).size();
+    EXPECT_LT(trained * 2, plain);
+
+    {
+        lmdbmap::transaction txn(*env);
+        orders.put(txn, 5000, record(5000));
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        EXPECT_EQ(orders.get(txn, 7), record(7));  // written before training
+        EXPECT_EQ(orders.get(txn, 5000), record(5000));
+
+        // Without its dictionary the value cannot be read.
+        EXPECT_EQ(lmdbmap::load_dictionaries<codec>(txn, "elsewhere"), 0u);
+        EXPECT_THROW(orders.get(txn, 5000), std::runtime_error);
+        EXPECT_EQ(orders.get(txn, 7), record(7));
+        lmdbmap::load_dictionaries<codec>(txn, "orders");
+        EXPECT_EQ(orders.get(txn, 5000), record(5000));
+    }
+}
+
+TEST_F(CompressionTest, DictionariesStayWithTheirEnvironment) {
+    using codec = lmdbmap::compressed_codec<std::string, orders_compression>;
+    std::filesystem::remove_all("test_db_compression_other");
+    lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, codec> orders(*env, "orders");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 2000; ++i) orders.put(txn, i, record(i));
+        lmdbmap::train_dictionary(txn, orders, "orders", 8 << 10);
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        EXPECT_EQ(lmdbmap::load_dictionaries<codec>(txn, "orders"), 1u);
+    }
+
+    // Same Config, other environment: its values must not use a
+    // dictionary that exists only in the first one.
+    {
+        lmdbmap::environment other("test_db_compression_other");
+        lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, codec> copy(other, "orders");
+        lmdbmap::transaction txn(other);
+        copy.put(txn, 1, record(1));
+        auto key = lmdbmap::key_codec<int>::encode(1);
+        MDB_val k = lmdbmap::to_mdb_val(key), v;
+        ASSERT_EQ(mdb_get(txn, copy.dbi(), &k, &v), 0);
+        ASSERT_GT(v.mv_size, 1u);
+        if (static_cast<const char*>(v.mv_data)[0] == static_cast<char>(lmdbmap::compression::zstd)) {
+            EXPECT_EQ(ZSTD_getDictID_fromFrame(static_cast<const char*>(v.mv_data) + 1, v.mv_size - 1), 0u);
+        }
+        txn.commit();
+    }
+    env.reset();
+    {
+        lmdbmap::environment other("test_db_compression_other");
+        lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, codec> copy(other, "orders");
+        lmdbmap::transaction txn(other, true);
+        EXPECT_EQ(copy.get(txn, 1), record(1));
+    }
+    std::filesystem::remove_all("test_db_compression_other");
+}
+
+TEST_F(CompressionTest, EveryShardUsesItsOwnDictionary) {
+    using codec = lmdbmap::compressed_codec<std::string, orders_compression>;
+    std::filesystem::remove_all("test_db_compression_sharded");
+    {
+        lmdbmap::sharded_map<int, std::string, lmdbmap::key_codec<int>, codec> m("test_db_compression_sharded", 3);
+        for (int i = 0; i < 3000; ++i) m.put(i, record(i));
+        for (size_t s = 0; s < m.shard_count(); ++s) {
+            lmdbmap::transaction txn(m.env(s));
+            lmdbmap::train_dictionary(txn, m.shard(s), "orders", 8 << 10);
+            txn.commit();
+            lmdbmap::transaction read(m.env(s), true);
+            EXPECT_EQ(lmdbmap::load_dictionaries<codec>(read, "orders"), 1u);
+        }
+        for (int i = 3000; i < 3100; ++i) m.put(i, record(i));
+        for (int i = 0; i < 3100; i += 7) EXPECT_EQ(m.get(i), record(i));
+    }
+    lmdbmap::sharded_map<int, std::string, lmdbmap::key_codec<int>, codec> m("test_db_compression_sharded", 3);
+    for (size_t s = 0; s < m.shard_count(); ++s) {
+        lmdbmap::transaction txn(m.env(s), true);
+        lmdbmap::load_dictionaries<codec>(txn, "orders");
+    }
+    for (int i = 3000; i < 3100; ++i) EXPECT_EQ(m.get(i), record(i));
+    std::filesystem::remove_all("test_db_compression_sharded");
+}
+#endif
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/coroutine.hpp>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if LMDBMAP_HAS_COROUTINES
+
+namespace {
+
+// Smallest eagerly started coroutine type; finished completes when it
+// returns.
+struct test_task {
+    struct promise_type {
+        std::promise<void> done;
+        test_task get_return_object() { return {done.get_future()}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { done.set_value(); }
+        void unhandled_exception() { done.set_exception(std::current_exception()); }
+    };
+    std::future<void> finished;
+};
+
+using string_map = lmdbmap::map<int, std::string>;
+
+test_task put_get_erase(lmdbmap::async_context& io, string_map& m, std::thread::id caller, bool& hopped) {
+    co_await io.async_put(m, 1, "one");
+    hopped = std::this_thread::get_id() != caller;
+    EXPECT_EQ(co_await io.async_get(m, 1), "one");
+    co_await io.async_erase(m, 1);
+    EXPECT_EQ(co_await io.async_get(m, 1), std::nullopt);
+}
+
+test_task transactions(lmdbmap::async_context& io, string_map& m) {
+    size_t n = co_await io.async_transaction([&](lmdbmap::transaction& txn) {
+        for (int i = 0; i < 10; ++i) m.put(txn, i, std::to_string(i));
+        return m.size(txn);
+    });
+    EXPECT_EQ(n, 10u);
+
+    // A failed write is rolled back and rethrown in the coroutine.
+    bool thrown = false;
+    try {
+        co_await io.async_transaction([&](lmdbmap::transaction& txn) {
+            m.put(txn, 100, "lost");
+            throw std::runtime_error("rejected");
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    EXPECT_TRUE(thrown);
+    EXPECT_EQ(co_await io.async_read([&](lmdbmap::transaction& txn) { return m.size(txn); }), 10u);
+
+    thrown = false;
+    try {
+        co_await io.async_read([](lmdbmap::transaction&) -> int { throw std::out_of_range("missing"); });
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    EXPECT_TRUE(thrown);
+}
+
+test_task writer_then_reader(lmdbmap::async_context& io, string_map& m, int k, std::vector<std::thread::id>& seen,
+                             std::mutex& lock) {
+    co_await io.async_put(m, k, std::to_string(k));
+    {
+        std::lock_guard<std::mutex> g(lock);
+        seen.push_back(std::this_thread::get_id());
+    }
+    auto v = co_await io.async_get(m, k);
+    EXPECT_EQ(v, std::to_string(k));
+}
+
+}
+
+class CoroutineTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_coroutine");
+        env = std::make_unique<lmdbmap::environment>("test_db_coroutine");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_coroutine");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(CoroutineTest, PutGetErase) {
+    string_map m(*env, "coro_map");
+    lmdbmap::async_context io(*env);
+    bool hopped = false;
+    put_get_erase(io, m, std::this_thread::get_id(), hopped).finished.get();
+    EXPECT_TRUE(hopped);
+}
+
+TEST_F(CoroutineTest, TransactionsAndErrors) {
+    string_map m(*env, "coro_map");
+    lmdbmap::async_context io(*env);
+    transactions(io, m).finished.get();
+}
+
+TEST_F(CoroutineTest, ResumesOnExecutor) {
+    string_map m(*env, "coro_map");
+
+    // A single-threaded "event loop" that resumes coroutines handed to it.
+    std::mutex queue_lock;
+    std::vector<std::coroutine_handle<>> queue;
+    lmdbmap::async_options options;
+    options.read_threads = 2;
+    options.resume = [&](std::coroutine_handle<> h) {
+        std::lock_guard<std::mutex> g(queue_lock);
+        queue.push_back(h);
+    };
+    lmdbmap::async_context io(*env, options);
+
+    std::mutex seen_lock;
+    std::vector<std::thread::id> seen;
+    std::vector<test_task> tasks;
+    for (int k = 0; k < 100; ++k) tasks.push_back(writer_then_reader(io, m, k, seen, seen_lock));
+
+    auto all_done = [&] {
+        for (auto& t : tasks) {
+            if (t.finished.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+        }
+        return true;
+    };
+    while (!all_done()) {
+        std::vector<std::coroutine_handle<>> ready;
+        {
+            std::lock_guard<std::mutex> g(queue_lock);
+            ready.swap(queue);
+        }
+        for (auto h : ready) h.resume();
+        std::this_thread::yield();
+    }
+    for (auto& t : tasks) t.finished.get();
+    ASSERT_EQ(seen.size(), 100u);
+    for (auto id : seen) EXPECT_EQ(id, std::this_thread::get_id());
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.size(txn), 100u);
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <lmdbmap/async_writer.hpp>
+#include <lmdbmap/bulk_loader.hpp>
+#include <filesystem>
+
+class EnvironmentTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_env");
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all("test_db_env");
+    }
+};
+
+TEST_F(EnvironmentTest, OptionsBuilder) {
+    auto options = lmdbmap::environment_options()
+        .write_map()
+        .no_meta_sync()
+        .no_sync()
+        .no_sync(false)
+        .max_readers(64);
+    EXPECT_EQ(options.flags(), unsigned(MDB_WRITEMAP | MDB_NOMETASYNC));
+
+    lmdbmap::environment env("test_db_env", options);
+    EXPECT_EQ(env.flags() & (MDB_WRITEMAP | MDB_NOMETASYNC | MDB_NOSYNC), unsigned(MDB_WRITEMAP | MDB_NOMETASYNC));
+    EXPECT_EQ(env.max_readers(), 64u);
+}
+
+TEST_F(EnvironmentTest, NoSyncWithExplicitSync) {
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options().no_sync().no_tls());
+    lmdbmap::map<int, int> m(env, "sync_map");
+    {
+        lmdbmap::transaction txn(env);
+        m.put(txn, 1, 2);
+        txn.commit();
+    }
+    EXPECT_NO_THROW(env.sync());
+
+    lmdbmap::read_txn txn(env);
+    EXPECT_EQ(m.get(txn, 1), 2);
+}
+
+TEST_F(EnvironmentTest, MapFullThrows) {
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options().map_size(64 << 10));
+    lmdbmap::map<int, std::string> m(env, "full_map");
+    lmdbmap::transaction txn(env);
+    EXPECT_THROW({
+        for (int i = 0; i < 1000; ++i) m.put(txn, i, std::string(1024, 'x'));
+    }, lmdbmap::map_full_error);
+}
+
+TEST_F(EnvironmentTest, TransactGrowsMap) {
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options().map_size(64 << 10));
+    lmdbmap::map<int, std::string> m(env, "grow_map");
+    size_t initial = env.map_size();
+
+    int attempts = 0;
+    int stored = lmdbmap::transact(env, [&](lmdbmap::transaction& txn) {
+        ++attempts;
+        for (int i = 0; i < 1000; ++i) m.put(txn, i, std::string(1024, 'x'));
+        return 1000;
+    });
+    EXPECT_EQ(stored, 1000);
+    EXPECT_GT(attempts, 1);
+    EXPECT_GT(env.map_size(), initial);
+
+    lmdbmap::read_txn txn(env);
+    EXPECT_EQ(m.get(txn, 999)->size(), 1024u);
+}
+
+TEST_F(EnvironmentTest, GrowthStopsAtMaxMapSize) {
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options()
+        .map_size(64 << 10)
+        .max_map_size(256 << 10));
+    lmdbmap::map<int, std::string> m(env, "max_map");
+    EXPECT_THROW(lmdbmap::transact(env, [&](lmdbmap::transaction& txn) {
+        for (int i = 0; i < 1000; ++i) m.put(txn, i, std::string(1024, 'x'));
+    }), lmdbmap::map_full_error);
+    EXPECT_EQ(env.map_size(), size_t(256 << 10));
+}
+
+TEST_F(EnvironmentTest, GrowWithOpenTransactionThrows) {
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options().map_size(64 << 10));
+    lmdbmap::read_txn txn(env);
+    EXPECT_THROW(env.grow(env.map_size()), std::logic_error);
+}
+
+TEST_F(EnvironmentTest, GrowGivesUpWhileOtherThreadHoldsTransaction) {
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options()
+        .map_size(64 << 10)
+        .resize_timeout(std::chrono::milliseconds(50)));
+    lmdbmap::map<int, std::string> m(env, "held_map");
+    lmdbmap::async_writer writer(env);
+    {
+        lmdbmap::read_txn held(env);
+        std::vector<std::future<void>> done;
+        for (int i = 0; i < 500; ++i) done.push_back(writer.put(m, i, std::string(1024, 'a')));
+        EXPECT_THROW(done.back().get(), lmdbmap::map_full_error);
+    }
+    EXPECT_NO_THROW(writer.put(m, 0, std::string(64 << 10, 'b')).get());
+}
+
+TEST_F(EnvironmentTest, WritersGrowMap) {
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options().map_size(64 << 10));
+    lmdbmap::map<int, std::string> m(env, "async_grow");
+    lmdbmap::map<int, std::string> bulk(env, "bulk_grow");
+    {
+        lmdbmap::async_writer writer(env);
+        std::vector<std::future<void>> done;
+        for (int i = 0; i < 500; ++i) done.push_back(writer.put(m, i, std::string(1024, 'a')));
+        for (auto& f : done) EXPECT_NO_THROW(f.get());
+    }
+    {
+        lmdbmap::bulk_load_options options;
+        options.commit_every = 100;
+        lmdbmap::bulk_loader<lmdbmap::map<int, std::string>> loader(env, bulk, options);
+        for (int i = 500; i-- > 0;) loader.add(i, std::string(1024, 'b'));
+        EXPECT_EQ(loader.finish(), 500u);
+    }
+
+    lmdbmap::read_txn txn(env);
+    EXPECT_EQ(m.get(txn, 499), std::string(1024, 'a'));
+    EXPECT_EQ(bulk.get(txn, 0), std::string(1024, 'b'));
+    EXPECT_EQ(bulk.get(txn, 499), std::string(1024, 'b'));
+}
+
+TEST_F(EnvironmentTest, RefusesDatabasesWithoutFormatMarker) {
+    {
+        // As written by lmdbmap 0.4: data, but no format marker.
+        lmdbmap::environment env("test_db_env", lmdbmap::environment_options().legacy_format());
+        lmdbmap::map<int, std::string, lmdbmap::boost_codec<int>, lmdbmap::boost_codec<std::string>> old(env, "old");
+        lmdbmap::transaction txn(env);
+        old.put(txn, 1, "one");
+        txn.commit();
+    }
+    EXPECT_THROW(lmdbmap::environment("test_db_env"), std::runtime_error);
+
+    lmdbmap::environment env("test_db_env", lmdbmap::environment_options().legacy_format());
+    lmdbmap::map<int, std::string, lmdbmap::boost_codec<int>, lmdbmap::boost_codec<std::string>> old(env, "old");
+    lmdbmap::read_txn txn(env);
+    EXPECT_EQ(old.get(txn, 1), "one");
+}
+
+TEST_F(EnvironmentTest, NewDatabasesGetFormatMarker) {
+    {
+        lmdbmap::environment env("test_db_env");
+        lmdbmap::map<int, int> m(env, "marked");
+        lmdbmap::transact(env, [&](lmdbmap::transaction& txn) { m.put(txn, 1, 2); });
+    }
+    lmdbmap::environment env("test_db_env");
+    lmdbmap::map<int, int> m(env, "marked");
+    lmdbmap::read_txn txn(env);
+    EXPECT_EQ(m.get(txn, 1), 2);
+}
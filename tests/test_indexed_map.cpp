@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/indexed_map.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct user {
+    std::string email;
+    std::string country;
+    int age = 0;
+
+    int decade() const { return age / 10; }
+
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int) {
+        ar & email & country & age;
+    }
+};
+
+struct by_country {
+    static constexpr const char* name = "country";
+    static std::string extract(const user& u) { return u.country; }
+};
+
+using by_email = lmdbmap::index_by<&user::email>;
+using by_decade = lmdbmap::index_by<&user::decade>;
+using users_map = lmdbmap::indexed_map<int, user, by_email, by_country, by_decade>;
+
+std::vector<int> keys_of(const std::vector<std::pair<int, user>>& entries) {
+    std::vector<int> keys;
+    for (const auto& e : entries) keys.push_back(e.first);
+    return keys;
+}
+
+}
+
+class IndexedMapTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_indexed");
+        env = std::make_unique<lmdbmap::environment>("test_db_indexed");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_indexed");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(IndexedMapTest, FindByKeepsIndexesInSync) {
+    users_map users(*env, "users");
+    lmdbmap::transaction txn(*env);
+    users.put(txn, 3, {"c@x", "fr", 31});
+    users.put(txn, 1, {"a@x", "de", 25});
+    users.put(txn, 2, {"b@x", "de", 38});
+    EXPECT_FALSE(users.insert(txn, 2, {"z@x", "us", 50}));
+
+    EXPECT_EQ(keys_of(users.find_by<by_country>(txn, "de")), (std::vector<int>{1, 2}));
+    EXPECT_EQ(users.find_by<by_email>(txn, "b@x").at(0).second.age, 38);
+    EXPECT_EQ(users.keys_by<by_decade>(txn, 3), (std::vector<int>{2, 3}));
+    EXPECT_EQ(users.count_by<by_country>(txn, "us"), 0u);
+
+    // Moving user 2 to another country drops the stale entry.
+    users.put(txn, 2, {"b@x", "fr", 41});
+    EXPECT_EQ(keys_of(users.find_by<by_country>(txn, "de")), (std::vector<int>{1}));
+    EXPECT_EQ(keys_of(users.find_by<by_country>(txn, "fr")), (std::vector<int>{2, 3}));
+    EXPECT_EQ(users.keys_by<by_decade>(txn, 3), (std::vector<int>{3}));
+    EXPECT_EQ(users.keys_by<by_decade>(txn, 4), (std::vector<int>{2}));
+    EXPECT_EQ(users.count_by<by_email>(txn, "b@x"), 1u);
+
+    EXPECT_TRUE(users.erase(txn, 3));
+    EXPECT_FALSE(users.erase(txn, 3));
+    EXPECT_EQ(keys_of(users.find_by<by_country>(txn, "fr")), (std::vector<int>{2}));
+    EXPECT_TRUE(users.find_by<by_email>(txn, "c@x").empty());
+    EXPECT_EQ(users.index<by_decade>().size(txn), 2u);
+    txn.commit();
+}
+
+TEST_F(IndexedMapTest, IndexesPersistAndRebuild) {
+    {
+        lmdbmap::map<int, user> plain(*env, "accounts");
+        lmdbmap::transaction txn(*env);
+        plain.put(txn, 1, {"a@x", "de", 25});
+        plain.put(txn, 2, {"b@x", "it", 52});
+        txn.commit();
+    }
+
+    users_map users(*env, "accounts");
+    {
+        lmdbmap::transaction txn(*env);
+        EXPECT_TRUE(users.find_by<by_country>(txn, "it").empty());
+        users.rebuild_indexes(txn);
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        EXPECT_EQ(keys_of(users.find_by<by_country>(txn, "it")), (std::vector<int>{2}));
+        EXPECT_EQ(users.keys_by<by_email>(txn, "a@x"), (std::vector<int>{1}));
+        EXPECT_EQ(users.size(txn), 2u);
+    }
+
+    users_map reopened(*env, "accounts");
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(reopened.keys_by<by_decade>(txn, 5), (std::vector<int>{2}));
+}
@@ -2,7 +2,38 @@
 #include <lmdbmap/map.hpp>
 #include <lmdbmap/environment.hpp>
 #include <lmdbmap/transaction.hpp>
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
+#include <tuple>
+
+namespace {
+
+int value_decodes = 0;
+
+struct counting_codec {
+    static std::string_view encode(const std::string& v) { return v; }
+    static std::string decode(const void* data, size_t size) {
+        ++value_decodes;
+        return std::string(static_cast<const char*>(data), size);
+    }
+};
+
+int reserved_writes = 0;
+
+// A codec that can only encode in place.
+struct reserve_codec {
+    static size_t encoded_size(const std::string& v) { return v.size(); }
+    static void encode_into(const std::string& v, void* out, size_t size) {
+        ++reserved_writes;
+        std::memcpy(out, v.data(), size);
+    }
+    static std::string decode(const void* data, size_t size) {
+        return std::string(static_cast<const char*>(data), size);
+    }
+};
+
+}
 
 class MapTest : public ::testing::Test {
 protected:
@@ -176,3 +207,402 @@ TEST_F(MapTest, RangeLoop) {
         EXPECT_EQ(count, 3);
     }
 }
+
+TEST_F(MapTest, NumericKeyOrder) {
+    lmdbmap::map<int, std::string> m(*env, "map_numeric");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int k : {300, -5, 0, 256, -300, 1, 70000}) {
+            m.put(txn, k, std::to_string(k));
+        }
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        std::vector<int> keys;
+        for (const auto& kv : m.range(txn)) keys.push_back(kv.first);
+        EXPECT_EQ(keys, (std::vector<int>{-300, -5, 0, 1, 256, 300, 70000}));
+
+        auto it = m.lower_bound(txn, 2);
+        ASSERT_NE(it, m.end(txn));
+        EXPECT_EQ(it->first, 256);
+
+        it = m.upper_bound(txn, -5);
+        ASSERT_NE(it, m.end(txn));
+        EXPECT_EQ(it->first, 0);
+    }
+}
+
+TEST_F(MapTest, StringAndFloatKeyOrder) {
+    lmdbmap::map<std::string, int> s(*env, "map_string_keys");
+    lmdbmap::map<double, int> d(*env, "map_double_keys");
+    {
+        lmdbmap::transaction txn(*env);
+        s.put(txn, "banana", 2);
+        s.put(txn, "apple", 1);
+        s.put(txn, "cherry", 3);
+        s.put(txn, "app", 0);
+        for (double k : {2.5, -1.0, 0.0, -100.25, 1e10}) d.put(txn, k, 0);
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        std::vector<std::string> skeys;
+        for (const auto& kv : s.range(txn)) skeys.push_back(kv.first);
+        EXPECT_EQ(skeys, (std::vector<std::string>{"app", "apple", "banana", "cherry"}));
+
+        auto it = s.lower_bound(txn, "b");
+        ASSERT_NE(it, s.end(txn));
+        EXPECT_EQ(it->first, "banana");
+
+        std::vector<double> dkeys;
+        for (const auto& kv : d.range(txn)) dkeys.push_back(kv.first);
+        EXPECT_EQ(dkeys, (std::vector<double>{-100.25, -1.0, 0.0, 2.5, 1e10}));
+    }
+}
+
+TEST_F(MapTest, TriviallyCopyableValues) {
+    struct sample {
+        int64_t id;
+        double score;
+    };
+    lmdbmap::map<int, sample> m(*env, "map_pod");
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, sample{42, 1.5});
+        m.put(txn, 2, sample{-7, 2.25});
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        auto v = m.get(txn, 2);
+        ASSERT_TRUE(v.has_value());
+        EXPECT_EQ(v->id, -7);
+        EXPECT_EQ(v->score, 2.25);
+
+        auto it = m.begin(txn);
+        ASSERT_NE(it, m.end(txn));
+        EXPECT_EQ(it->second.id, 42);
+    }
+}
+
+TEST_F(MapTest, Views) {
+    lmdbmap::map<int, std::string> m(*env, "map_views");
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, "one");
+        m.put(txn, 2, std::string(10000, 'x'));
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        auto v = m.get_view(txn, 1);
+        ASSERT_TRUE(v.has_value());
+        EXPECT_EQ(v->str(), "one");
+        EXPECT_FALSE(m.get_view(txn, 3).has_value());
+
+        std::string_view big = *m.get_view(txn, 2);
+        EXPECT_EQ(big.size(), 10000u);
+        EXPECT_EQ(big.find_first_not_of('x'), std::string_view::npos);
+
+        auto it = m.begin(txn);
+        EXPECT_EQ(it.value_view().str(), "one");
+        EXPECT_EQ(it.key_view().decode<lmdbmap::key_codec<int>>(), 1);
+        EXPECT_THROW(m.end(txn).value_view(), std::out_of_range);
+    }
+}
+
+#if LMDBMAP_CHECK_VIEWS
+TEST_F(MapTest, ViewAfterTransactionEnds) {
+    lmdbmap::map<int, std::string> m(*env, "map_view_check");
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, "one");
+        txn.commit();
+    }
+    lmdbmap::byte_view v;
+    {
+        lmdbmap::transaction txn(*env, true);
+        v = *m.get_view(txn, 1);
+        EXPECT_EQ(v.str(), "one");
+    }
+    EXPECT_THROW(v.str(), std::logic_error);
+}
+#endif
+
+TEST_F(MapTest, LazyDecoding) {
+    lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, counting_codec> m(*env, "map_lazy");
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, "one");
+        m.put(txn, 2, "two");
+        m.put(txn, 3, "three");
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        value_decodes = 0;
+
+        std::vector<int> keys;
+        for (int k : m.keys(txn)) keys.push_back(k);
+        EXPECT_EQ(keys, (std::vector<int>{1, 2, 3}));
+
+        auto it = m.lower_bound(txn, 2);
+        EXPECT_EQ(it.key(), 2);
+        ++it;
+        EXPECT_EQ(value_decodes, 0);
+
+        EXPECT_EQ(it->second, "three");
+        EXPECT_EQ(it.value(), "three");
+        EXPECT_EQ(value_decodes, 1);
+
+        std::vector<std::string> values(m.values(txn).begin(), m.values(txn).end());
+        EXPECT_EQ(values, (std::vector<std::string>{"one", "two", "three"}));
+    }
+}
+
+TEST_F(MapTest, IteratorCopies) {
+    lmdbmap::map<int, std::string> m(*env, "map_copies");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 1; i <= 4; ++i) m.put(txn, i, std::to_string(i));
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        auto it = m.begin(txn);
+        auto old = it++;
+        EXPECT_EQ(old->first, 1);
+        EXPECT_EQ(it->first, 2);
+
+        auto copy = it;
+        ++copy;
+        ++copy;
+        EXPECT_EQ(it->first, 2);
+        EXPECT_EQ(copy->first, 4);
+        ++old;
+        EXPECT_EQ(old, it);
+
+        auto moved = std::move(copy);
+        EXPECT_EQ(moved->second, "4");
+        ++moved;
+        EXPECT_EQ(moved, m.end(txn));
+
+        for (int round = 0; round < 100; ++round) {
+            auto found = m.find(txn, round % 5);
+            EXPECT_EQ(found == m.end(txn), round % 5 == 0);
+        }
+    }
+}
+
+TEST_F(MapTest, IteratorsInWriteTransaction) {
+    lmdbmap::map<int, std::string> m(*env, "map_write_iter");
+    lmdbmap::transaction txn(*env);
+    m.put(txn, 1, "one");
+    m.put(txn, 2, "two");
+    auto it = m.find(txn, 1);
+    EXPECT_EQ(it->second, "one");
+    auto range = m.equal_range(txn, 2);
+    EXPECT_EQ(range.first->first, 2);
+    EXPECT_EQ(range.second, m.end(txn));
+    txn.commit();
+}
+
+TEST_F(MapTest, IteratorCopiesSurviveWrites) {
+    lmdbmap::map<std::string, std::string> m(*env, "map_write_copies");
+    lmdbmap::transaction txn(*env);
+    for (int i = 0; i < 10; ++i) m.put(txn, "key" + std::to_string(i), std::string(100, char('a' + i)));
+    auto it = m.find(txn, "key5");
+    auto copy = it;
+    auto gone = m.find(txn, "key7");
+    auto copy_of_gone = gone;
+    it = m.end(txn);
+    gone = m.end(txn);
+
+    // Rewrites the entry the copy sits on, and erases another.
+    m.erase(txn, "key5");
+    m.put(txn, "key5", std::string(3000, 'z'));
+    m.erase(txn, "key7");
+
+    EXPECT_EQ(copy.key(), "key5");
+    EXPECT_EQ(copy.value(), std::string(3000, 'z'));
+    EXPECT_EQ(copy.value_view().size(), 3000u);
+    ++copy;
+    EXPECT_EQ(copy->first, "key6");
+    EXPECT_THROW(++copy_of_gone, std::runtime_error);
+}
+
+TEST_F(MapTest, GetMany) {
+    lmdbmap::map<int, std::string> m(*env, "map_get_many");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 100; i += 2) m.put(txn, i, std::to_string(i));
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        std::vector<int> keys{50, 3, 4, 98, 99, 4, 0, -1, 51, 52, 200, 6};
+        auto results = m.get_many(txn, keys);
+        ASSERT_EQ(results.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            int k = keys[i];
+            if (k >= 0 && k < 100 && k % 2 == 0) {
+                ASSERT_TRUE(results[i].has_value()) << k;
+                EXPECT_EQ(*results[i], std::to_string(k));
+            } else {
+                EXPECT_FALSE(results[i].has_value()) << k;
+            }
+        }
+        EXPECT_TRUE(m.get_many(txn, {}).empty());
+    }
+}
+
+TEST_F(MapTest, ReservedWrites) {
+    lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, reserve_codec> m(*env, "reserve_map");
+    lmdbmap::map<int, std::vector<int>> boost_map(*env, "reserve_boost_map");
+    std::vector<int> large(4096);
+    for (int i = 0; i < 4096; ++i) large[i] = i;
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, std::string(8192, 'x'));
+        EXPECT_TRUE(m.insert(txn, 2, "two"));
+        EXPECT_FALSE(m.insert(txn, 2, "again"));
+        boost_map.put(txn, 1, large);
+        txn.commit();
+    }
+    EXPECT_EQ(reserved_writes, 2);
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.get(txn, 1), std::string(8192, 'x'));
+    EXPECT_EQ(m.get(txn, 2), "two");
+    EXPECT_EQ(boost_map.get(txn, 1), large);
+}
+
+TEST_F(MapTest, BoostValuesEncodeIntoScratch) {
+    using codec = lmdbmap::value_codec<std::vector<int>>;
+    static_assert(lmdbmap::detail::has_encode_to<codec, std::vector<int>>::value);
+    lmdbmap::map<int, std::vector<int>> m(*env, "scratch_map");
+    std::vector<int> large(4096);
+    for (int i = 0; i < 4096; ++i) large[i] = i;
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, large);
+        m.put(txn, 2, {1, 2, 3});
+        EXPECT_TRUE(m.insert(txn, 3, large));
+        EXPECT_FALSE(m.insert(txn, 3, {}));
+        txn.commit();
+    }
+    {
+        // The buffer the puts encoded into is kept for the next one.
+        lmdbmap::detail::scratch buf;
+        EXPECT_TRUE(buf.bytes().empty());
+        EXPECT_GE(buf.bytes().capacity(), large.size() * sizeof(int));
+    }
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.get(txn, 1), large);
+    EXPECT_EQ(m.get(txn, 2), (std::vector<int>{1, 2, 3}));
+    EXPECT_EQ(m.get(txn, 3), large);
+    std::string bytes = lmdbmap::serialize(large);
+    EXPECT_EQ(codec::decode(bytes.data(), bytes.size()), large);
+}
+
+TEST_F(MapTest, SizeAndCount) {
+    lmdbmap::map<int, std::string> m(*env, "map_count");
+    {
+        lmdbmap::transaction txn(*env);
+        EXPECT_EQ(m.size(txn), 0u);
+        for (int i = 0; i < 100; i += 2) m.put(txn, i, "v");
+        txn.commit();
+    }
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.size(txn), 50u);
+    EXPECT_EQ(m.count(txn, 10), 1u);
+    EXPECT_EQ(m.count(txn, 11), 0u);
+    EXPECT_EQ(m.count_range(txn, 10, 20), 5u);
+    EXPECT_EQ(m.count_range(txn, 11, 21), 5u);
+    EXPECT_EQ(m.count_range(txn, -100, 1000), 50u);
+    EXPECT_EQ(m.count_range(txn, 20, 10), 0u);
+}
+
+TEST_F(MapTest, ReverseIteration) {
+    lmdbmap::map<int, std::string> m(*env, "map_reverse");
+    lmdbmap::transaction txn(*env);
+    EXPECT_EQ(m.rbegin(txn), m.rend(txn));
+    for (int i = 0; i < 10; ++i) m.put(txn, i, std::to_string(i));
+
+    std::vector<int> keys;
+    for (auto it = m.rbegin(txn); it != m.rend(txn); ++it) keys.push_back(it->first);
+    EXPECT_EQ(keys, (std::vector<int>{9, 8, 7, 6, 5, 4, 3, 2, 1, 0}));
+
+    // Latest three entries.
+    auto it = m.rbegin(txn);
+    std::vector<std::string> latest;
+    for (int n = 0; n < 3 && it != m.rend(txn); ++n, ++it) latest.push_back(it.value());
+    EXPECT_EQ(latest, (std::vector<std::string>{"9", "8", "7"}));
+
+    auto last = m.end(txn);
+    --last;
+    EXPECT_EQ(last.key(), 9);
+    auto pos = m.find(txn, 5);
+    --pos;
+    EXPECT_EQ(pos.key(), 4);
+    ++pos;
+    EXPECT_EQ(pos.key(), 5);
+    auto first = m.begin(txn);
+    --first;
+    EXPECT_EQ(first, m.end(txn));
+    ++first;
+    EXPECT_EQ(first.key(), 0);
+    EXPECT_EQ(std::distance(m.begin(txn), m.end(txn)), 10);
+}
+
+TEST_F(MapTest, BoundedRange) {
+    lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, counting_codec> m(*env, "map_bounded");
+    lmdbmap::transaction txn(*env);
+    for (int i = 0; i < 100; i += 10) m.put(txn, i, std::to_string(i));
+
+    auto collect = [&](int lo, int hi, bool include_lo, bool include_hi) {
+        std::vector<int> keys;
+        for (const auto& kv : m.range(txn, lo, hi, include_lo, include_hi)) keys.push_back(kv.first);
+        return keys;
+    };
+    value_decodes = 0;
+    EXPECT_EQ(collect(20, 50, true, false), (std::vector<int>{20, 30, 40}));
+    EXPECT_EQ(value_decodes, 3);
+    EXPECT_EQ(collect(20, 50, false, true), (std::vector<int>{30, 40, 50}));
+    EXPECT_EQ(collect(20, 50, true, true), (std::vector<int>{20, 30, 40, 50}));
+    EXPECT_EQ(collect(21, 49, true, true), (std::vector<int>{30, 40}));
+    EXPECT_EQ(collect(50, 20, true, true), std::vector<int>{});
+    EXPECT_EQ(collect(85, 1000, true, false), (std::vector<int>{90}));
+    EXPECT_EQ(collect(-10, 0, true, false), std::vector<int>{});
+}
+
+TEST_F(MapTest, PrefixRange) {
+    using key = std::tuple<std::string, std::string, uint64_t>;
+    lmdbmap::map<key, int> m(*env, "map_prefix");
+    lmdbmap::transaction txn(*env);
+    int n = 0;
+    for (std::string tenant : {"acme", "acme2", "ac", "zeta"}) {
+        for (std::string user : {"ann", "bob"}) {
+            for (uint64_t ts : {30u, 10u, 20u}) m.put(txn, key{tenant, user, ts}, n++);
+        }
+    }
+
+    std::vector<key> keys;
+    for (const auto& kv : m.prefix_range(txn, "acme")) keys.push_back(kv.first);
+    ASSERT_EQ(keys.size(), 6u);
+    EXPECT_EQ(keys.front(), key("acme", "ann", 10));
+    EXPECT_EQ(keys.back(), key("acme", "bob", 30));
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+
+    keys.clear();
+    for (const auto& kv : m.prefix_range(txn, "acme", "bob")) keys.push_back(kv.first);
+    EXPECT_EQ(keys, (std::vector<key>{{"acme", "bob", 10}, {"acme", "bob", 20}, {"acme", "bob", 30}}));
+
+    EXPECT_EQ(std::distance(m.prefix_range(txn, "acme", "bob", 20).begin(), m.prefix_range(txn, "acme", "bob", 20).end()), 1);
+    auto none = m.prefix_range(txn, "acm");
+    EXPECT_TRUE(none.begin() == none.end());
+    auto past = m.prefix_range(txn, "zz");
+    EXPECT_TRUE(past.begin() == past.end());
+}
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/multimap.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Writes through MDB_RESERVE, slowly enough to tell codec from LMDB time.
+struct slow_reserve_codec {
+    static size_t encoded_size(const std::string& v) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return v.size();
+    }
+    static void encode_into(const std::string& v, void* out, size_t size) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::memcpy(out, v.data(), size);
+    }
+    static std::string decode(const void* data, size_t size) {
+        return std::string(static_cast<const char*>(data), size);
+    }
+};
+
+}
+
+class MetricsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_metrics");
+        env = std::make_unique<lmdbmap::environment>("test_db_metrics");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_metrics");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST(HistogramTest, BucketsAndPercentiles) {
+    using lmdbmap::histogram;
+    for (uint64_t v : {0ull, 1ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull, ~0ull}) {
+        size_t b = histogram::bucket_of(v);
+        ASSERT_LT(b, histogram::bucket_count);
+        EXPECT_LE(histogram::bucket_floor(b), v);
+        if (b + 1 < histogram::bucket_count) EXPECT_GT(histogram::bucket_floor(b + 1), v);
+    }
+
+    histogram h;
+    for (uint64_t v = 1; v <= 1000; ++v) h.record(v * 1000);
+    lmdbmap::histogram_snapshot s = h.snapshot();
+    EXPECT_EQ(s.count, 1000u);
+    EXPECT_EQ(s.max, 1000000u);
+    EXPECT_DOUBLE_EQ(s.mean(), 500500.0);
+    EXPECT_NEAR(static_cast<double>(s.percentile(0.5)), 500000.0, 500000.0 / 16);
+    EXPECT_NEAR(static_cast<double>(s.percentile(0.99)), 990000.0, 990000.0 / 16);
+    EXPECT_EQ(s.percentile(1.0), 1000000u);
+}
+
+TEST(HistogramTest, ConcurrentRecords) {
+    lmdbmap::histogram h;
+    lmdbmap::counter c;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 12; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10000; ++i) {
+                h.record(i);
+                c.add(2);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(h.snapshot().count, 120000u);
+    EXPECT_EQ(h.snapshot().max, 9999u);
+    EXPECT_EQ(c.load(), 240000u);
+}
+
+TEST_F(MetricsTest, MapOperations) {
+    lmdbmap::map<int, std::string> m(*env, "counted");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 10; ++i) m.put(txn, i, std::string(100, 'x'));
+        EXPECT_FALSE(m.insert(txn, 3, "again"));
+        m.erase(txn, 9);
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 100, "rolled back");
+    }
+
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_TRUE(m.get(txn, 1));
+    EXPECT_FALSE(m.get(txn, 42));
+    m.get_many(txn, {1, 2, 9});
+    size_t seen = 0;
+    for (auto it = m.begin(txn); it != m.end(txn); ++it) ++seen;
+    EXPECT_EQ(seen, 9u);
+
+    lmdbmap::map_metrics_snapshot s = m.metrics(txn);
+    EXPECT_EQ(s.name, "counted");
+    EXPECT_EQ(s.puts, 11u);
+    EXPECT_EQ(s.existing_inserts, 1u);
+    EXPECT_EQ(s.erases, 1u);
+    EXPECT_EQ(s.gets, 5u);
+    EXPECT_EQ(s.hits, 3u);
+    EXPECT_EQ(s.misses, 2u);
+    EXPECT_EQ(s.scans, 1u);
+    EXPECT_EQ(s.put_latency.count, 11u);
+    EXPECT_EQ(s.get_latency.count, 2u);
+    EXPECT_GE(s.bytes_encoded, 10 * 100u);
+    EXPECT_GE(s.bytes_decoded, 3 * 100u);
+    EXPECT_EQ(s.entries, 9u);
+    EXPECT_GE(s.depth, 1u);
+    EXPECT_GE(s.leaf_pages, 1u);
+
+    lmdbmap::environment_metrics_snapshot e = env->metrics_snapshot();
+    EXPECT_EQ(e.commits, 2u);  // one from opening the map
+    EXPECT_EQ(e.aborts, 1u);
+    EXPECT_EQ(e.write_txns, 3u);
+    EXPECT_EQ(e.write_wait.count, 3u);
+    EXPECT_EQ(e.write_txn_duration.count, 3u);
+    EXPECT_EQ(e.read_txns, 1u);
+    EXPECT_EQ(e.read_txn_duration.count, 0u);  // still open
+    EXPECT_GE(e.last_txnid, 2u);
+    EXPECT_GT(e.map_size, 0u);
+    EXPECT_GT(e.page_size, 0u);
+}
+
+TEST_F(MetricsTest, MultimapOperations) {
+    lmdbmap::multimap<int, int> mm(*env, "postings");
+    lmdbmap::transaction txn(*env);
+    for (int i = 0; i < 5; ++i) mm.insert(txn, 1, i);
+    EXPECT_EQ(mm.get(txn, 1).size(), 5u);
+    EXPECT_TRUE(mm.get(txn, 2).empty());
+    mm.erase(txn, 1, 0);
+    mm.find(txn, 1);
+
+    lmdbmap::map_metrics_snapshot s = mm.metrics(txn);
+    EXPECT_EQ(s.puts, 5u);
+    EXPECT_EQ(s.hits, 1u);
+    EXPECT_EQ(s.misses, 1u);
+    EXPECT_EQ(s.erases, 1u);
+    EXPECT_EQ(s.scans, 1u);
+    EXPECT_EQ(s.bytes_decoded, 5 * sizeof(int));
+    EXPECT_EQ(s.entries, 4u);
+}
+
+TEST_F(MetricsTest, ReservedWritesChargeEncoding) {
+    lmdbmap::map<int, std::string, lmdbmap::key_codec<int>, slow_reserve_codec> m(*env, "metrics_reserve");
+    lmdbmap::transaction txn(*env);
+    m.put(txn, 1, "value");
+
+    lmdbmap::map_metrics_snapshot s = m.metrics(txn);
+    EXPECT_GE(s.encode_ns, 20000000u);
+    EXPECT_LT(s.lmdb_ns, 10000000u);
+    EXPECT_EQ(s.bytes_encoded, sizeof(int) + 5);
+
+    // Nothing is reserved or encoded when the key exists.
+    EXPECT_FALSE(m.insert(txn, 1, "other"));
+    s = m.metrics(txn);
+    EXPECT_EQ(s.puts, 1u);
+    EXPECT_EQ(s.existing_inserts, 1u);
+    EXPECT_EQ(s.put_latency.count, 1u);
+    EXPECT_EQ(s.bytes_encoded, 2 * sizeof(int) + 5);
+}
@@ -1,8 +1,12 @@
 #include <gtest/gtest.h>
 #include <lmdbmap/multimap.hpp>
+#include <lmdbmap/fixed_multimap.hpp>
 #include <lmdbmap/environment.hpp>
 #include <lmdbmap/transaction.hpp>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <tuple>
 
 class MultimapTest : public ::testing::Test {
 protected:
@@ -125,3 +129,187 @@ TEST_F(MultimapTest, RangeLoop) {
         EXPECT_EQ(count, 2);
     }
 }
+
+TEST_F(MultimapTest, IteratorViews) {
+    lmdbmap::multimap<std::string, std::string> m(*env, "mmap_views");
+    {
+        lmdbmap::transaction txn(*env);
+        m.insert(txn, "k", "a");
+        m.insert(txn, "k", "b");
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        std::vector<std::string> vals;
+        for (auto it = m.find(txn, "k"); it != m.end(txn); ++it) {
+            EXPECT_EQ(it.key_view().str(), "k");
+            vals.emplace_back(it.value_view().str());
+        }
+        EXPECT_EQ(vals, (std::vector<std::string>{"a", "b"}));
+    }
+}
+
+TEST_F(MultimapTest, IteratorCopiesSurviveWrites) {
+    lmdbmap::multimap<std::string, std::string> mm(*env, "mm_write_copies");
+    lmdbmap::transaction txn(*env);
+    for (int i = 0; i < 5; ++i) {
+        mm.insert(txn, "a", "v" + std::to_string(i));
+        mm.insert(txn, "b", "v" + std::to_string(i));
+    }
+    auto range = mm.equal_range(txn, "a");
+    auto it = range.first;
+    ++it;
+    auto copy = it;
+    it = mm.end(txn);
+
+    mm.erase(txn, "a", "v1");
+    mm.insert(txn, "a", "v1");
+    mm.erase(txn, "a", "v0");
+
+    EXPECT_EQ(copy.key(), "a");
+    EXPECT_EQ(copy.value(), "v1");
+    EXPECT_EQ(copy.value_view().size(), 2u);
+    ++copy;
+    EXPECT_EQ(copy->second, "v2");
+}
+
+TEST_F(MultimapTest, KeysAndValues) {
+    lmdbmap::multimap<int, int> m(*env, "mmap_projection");
+    {
+        lmdbmap::transaction txn(*env);
+        m.insert(txn, 1, 10);
+        m.insert(txn, 1, 11);
+        m.insert(txn, 2, 20);
+        txn.commit();
+    }
+    {
+        lmdbmap::transaction txn(*env, true);
+        std::vector<int> keys, values;
+        for (int k : m.keys(txn)) keys.push_back(k);
+        for (int v : m.values(txn)) values.push_back(v);
+        EXPECT_EQ(keys, (std::vector<int>{1, 1, 2}));
+        EXPECT_EQ(values, (std::vector<int>{10, 11, 20}));
+    }
+}
+
+TEST_F(MultimapTest, FixedValuesReadByPage) {
+    lmdbmap::fixed_multimap<std::string, std::uint32_t> postings(*env, "postings");
+    static_assert(lmdbmap::fixed_multimap<std::string, std::uint32_t>::integer_dups);
+    {
+        lmdbmap::transaction txn(*env);
+        for (std::uint32_t i = 100; i > 0; --i) postings.insert(txn, "term", i * 1000);
+        postings.insert(txn, "other", 7);
+        postings.erase(txn, "term", 50000u);
+        txn.commit();
+    }
+
+    lmdbmap::transaction txn(*env, true);
+    std::vector<std::uint32_t> ids = postings.get(txn, "term");
+    ASSERT_EQ(ids.size(), 99u);
+    EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+    EXPECT_EQ(ids.front(), 1000u);
+    EXPECT_EQ(ids.back(), 100000u);
+    EXPECT_TRUE(postings.get(txn, "missing").empty());
+
+    size_t pages = 0;
+    std::vector<std::uint32_t> paged;
+    postings.for_each_page(txn, "term", [&](const lmdbmap::byte_view& page) {
+        ++pages;
+        size_t n = page.size() / sizeof(std::uint32_t);
+        size_t at = paged.size();
+        paged.resize(at + n);
+        std::memcpy(paged.data() + at, page.data(), page.size());
+    });
+    EXPECT_GT(pages, 1u);
+    EXPECT_EQ(paged, ids);
+
+    // Still a regular multimap for everything else.
+    auto range = postings.equal_range(txn, "other");
+    ASSERT_NE(range.first, range.second);
+    EXPECT_EQ(range.first->second, 7u);
+}
+
+TEST_F(MultimapTest, FixedStructValues) {
+    struct point { std::int32_t x, y; };
+    lmdbmap::fixed_multimap<int, point> m(*env, "points");
+    static_assert(!lmdbmap::fixed_multimap<int, point>::integer_dups);
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 20; ++i) m.insert(txn, 1, point{i, -i});
+        txn.commit();
+    }
+    lmdbmap::transaction txn(*env, true);
+    auto points = m.get(txn, 1);
+    ASSERT_EQ(points.size(), 20u);
+    int sum = 0;
+    for (const point& p : points) {
+        EXPECT_EQ(p.y, -p.x);
+        sum += p.x;
+    }
+    EXPECT_EQ(sum, 190);
+}
+
+TEST_F(MultimapTest, SizeAndCount) {
+    lmdbmap::multimap<int, std::string> m(*env, "mmap_count");
+    {
+        lmdbmap::transaction txn(*env);
+        EXPECT_EQ(m.size(txn), 0u);
+        for (int k = 0; k < 10; ++k) {
+            for (int i = 0; i <= k; ++i) m.insert(txn, k, std::to_string(i));
+        }
+        txn.commit();
+    }
+    lmdbmap::transaction txn(*env, true);
+    EXPECT_EQ(m.size(txn), 55u);
+    EXPECT_EQ(m.count(txn, 0), 1u);
+    EXPECT_EQ(m.count(txn, 9), 10u);
+    EXPECT_EQ(m.count(txn, 42), 0u);
+    EXPECT_EQ(m.count_range(txn, 2, 5), 3u + 4u + 5u);
+    EXPECT_EQ(m.count_range(txn, -5, 100), 55u);
+    EXPECT_EQ(m.count_range(txn, 5, 5), 0u);
+}
+
+TEST_F(MultimapTest, ReverseAndBoundedRange) {
+    lmdbmap::multimap<int, int> m(*env, "mmap_reverse");
+    lmdbmap::transaction txn(*env);
+    for (int k = 0; k < 5; ++k) {
+        for (int v = 0; v < 3; ++v) m.insert(txn, k, v);
+    }
+
+    std::vector<std::pair<int, int>> seen;
+    for (auto it = m.rbegin(txn); it != m.rend(txn); ++it) seen.emplace_back(it.key(), it.value());
+    ASSERT_EQ(seen.size(), 15u);
+    EXPECT_EQ(seen.front(), std::make_pair(4, 2));
+    EXPECT_EQ(seen[1], std::make_pair(4, 1));
+    EXPECT_EQ(seen.back(), std::make_pair(0, 0));
+
+    std::vector<std::pair<int, int>> ranged;
+    for (const auto& kv : m.range(txn, 1, 3)) ranged.push_back(kv);
+    ASSERT_EQ(ranged.size(), 6u);
+    EXPECT_EQ(ranged.front(), std::make_pair(1, 0));
+    EXPECT_EQ(ranged.back(), std::make_pair(2, 2));
+
+    ranged.clear();
+    for (const auto& kv : m.range(txn, 1, 3, false, true)) ranged.push_back(kv);
+    ASSERT_EQ(ranged.size(), 6u);
+    EXPECT_EQ(ranged.front(), std::make_pair(2, 0));
+    EXPECT_EQ(ranged.back(), std::make_pair(3, 2));
+}
+
+TEST_F(MultimapTest, PrefixRange) {
+    lmdbmap::multimap<std::tuple<int32_t, std::string>, int> m(*env, "mmap_prefix");
+    lmdbmap::transaction txn(*env);
+    for (int32_t tenant : {-1, 0, 1}) {
+        m.insert(txn, {tenant, "a"}, 1);
+        m.insert(txn, {tenant, "a"}, 2);
+        m.insert(txn, {tenant, "b"}, 3);
+    }
+
+    std::vector<int> values;
+    for (const auto& kv : m.prefix_range(txn, 0)) values.push_back(kv.second);
+    EXPECT_EQ(values, (std::vector<int>{1, 2, 3}));
+
+    values.clear();
+    for (const auto& kv : m.prefix_range(txn, -1, "a")) values.push_back(kv.second);
+    EXPECT_EQ(values, (std::vector<int>{1, 2}));
+}
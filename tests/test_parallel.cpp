@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/parallel.hpp>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/multimap.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+class ParallelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_parallel");
+        env = std::make_unique<lmdbmap::environment>("test_db_parallel");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_parallel");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(ParallelTest, ForEachVisitsEveryEntryOnce) {
+    lmdbmap::map<int, int> m(*env, "par_map");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = -5000; i < 5000; ++i) m.put(txn, i, i * 2);
+        txn.commit();
+    }
+
+    std::mutex mutex;
+    std::multiset<int> seen;
+    std::atomic<long long> sum{0};
+    lmdbmap::parallel_for_each(*env, m, [&](const std::pair<int, int>& kv) {
+        EXPECT_EQ(kv.second, kv.first * 2);
+        sum += kv.second;
+        std::lock_guard<std::mutex> lock(mutex);
+        seen.insert(kv.first);
+    }, 4);
+    EXPECT_EQ(seen.size(), 10000u);
+    EXPECT_EQ(std::set<int>(seen.begin(), seen.end()).size(), 10000u);
+    EXPECT_EQ(sum.load(), -10000);
+}
+
+TEST_F(ParallelTest, ReduceInKeyOrder) {
+    lmdbmap::map<std::string, int> m(*env, "par_strings");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 2000; ++i) {
+            char key[16];
+            std::snprintf(key, sizeof(key), "key%05d", i);
+            m.put(txn, key, i);
+        }
+        txn.commit();
+    }
+
+    // Concatenation is not commutative, so this checks range order.
+    std::string order = lmdbmap::parallel_reduce(*env, m, std::string(),
+        [](std::string acc, const std::pair<std::string, int>& kv) { return acc + kv.first.substr(3) + ","; },
+        [](std::string a, const std::string& b) { return a + b; }, 8);
+    std::string expected;
+    for (int i = 0; i < 2000; ++i) {
+        char key[16];
+        std::snprintf(key, sizeof(key), "%05d,", i);
+        expected += key;
+    }
+    EXPECT_EQ(order, expected);
+
+    long long count = lmdbmap::parallel_reduce(*env, m, 0LL,
+        [](long long acc, const std::pair<std::string, int>&) { return acc + 1; },
+        [](long long a, long long b) { return a + b; });
+    EXPECT_EQ(count, 2000);
+}
+
+TEST_F(ParallelTest, MultimapAndEmpty) {
+    lmdbmap::multimap<int, int> mm(*env, "par_multimap");
+    lmdbmap::map<int, int> empty(*env, "par_empty");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int k = 0; k < 100; ++k) {
+            for (int v = 0; v < 10; ++v) mm.insert(txn, k, v);
+        }
+        txn.commit();
+    }
+    long long total = lmdbmap::parallel_reduce(*env, mm, 0LL,
+        [](long long acc, const std::pair<int, int>& kv) { return acc + kv.second; },
+        [](long long a, long long b) { return a + b; }, 3);
+    EXPECT_EQ(total, 100 * 45);
+
+    int visited = 0;
+    lmdbmap::parallel_for_each(*env, empty, [&](const std::pair<int, int>&) { ++visited; });
+    EXPECT_EQ(visited, 0);
+    EXPECT_EQ(lmdbmap::parallel_reduce(*env, empty, 7, [](int a, const std::pair<int, int>&) { return a; },
+                                       [](int a, int b) { return a + b; }), 7);
+}
+
+TEST_F(ParallelTest, ExceptionPropagates) {
+    lmdbmap::map<int, int> m(*env, "par_throw");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 1000; ++i) m.put(txn, i, i);
+        txn.commit();
+    }
+    EXPECT_THROW(lmdbmap::parallel_for_each(*env, m, [](const std::pair<int, int>& kv) {
+        if (kv.first == 500) throw std::runtime_error("stop");
+    }, 4), std::runtime_error);
+}
+
+TEST_F(ParallelTest, OneSnapshotUnderSteadyWriter) {
+    // Every commit adds key n and sets key -1 to n + 1, so a scan on one
+    // snapshot sees exactly as many other keys as key -1 says.
+    lmdbmap::map<int, int> m(*env, "par_writer");
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        for (int n = 0; !stop; ++n) {
+            lmdbmap::transaction txn(*env);
+            m.put(txn, n, n);
+            m.put(txn, -1, n + 1);
+            txn.commit();
+        }
+    });
+    for (int round = 0; round < 20; ++round) {
+        std::atomic<long> keys{0}, counter{-1};
+        lmdbmap::parallel_for_each(*env, m, [&](const std::pair<int, int>& kv) {
+            if (kv.first == -1) {
+                counter = kv.second;
+            } else {
+                ++keys;
+            }
+        }, 4);
+        if (counter >= 0) EXPECT_EQ(keys.load(), counter.load());
+    }
+    stop = true;
+    writer.join();
+}
+
+TEST_F(ParallelTest, ReadOnlyEnvironment) {
+    lmdbmap::map<int, int> m(*env, "par_read_only");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 1000; ++i) m.put(txn, i, i);
+        txn.commit();
+    }
+    env.reset();
+    env = std::make_unique<lmdbmap::environment>("test_db_parallel", lmdbmap::environment_options().flags(MDB_RDONLY));
+    lmdbmap::map<int, int> reopened(*env, "par_read_only");
+    std::atomic<int> seen{0};
+    lmdbmap::parallel_for_each(*env, reopened, [&](const std::pair<int, int>&) { ++seen; }, 4);
+    EXPECT_EQ(seen, 1000);
+}
+
+TEST(BarrierTest, DroppingReleasesWaiters) {
+    // What parallel_scan does for workers it could not start.
+    lmdbmap::detail::barrier sync(3);
+    std::thread waiter([&] { sync.arrive_and_wait(); });
+    sync.arrive_and_drop();
+    sync.arrive_and_drop();
+    waiter.join();
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/serialization.hpp>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+template<typename Codec, typename T>
+std::string encoded(const T& obj) {
+    auto bytes = Codec::encode(obj);
+    return std::string(bytes.data(), bytes.size());
+}
+
+template<typename T>
+void expect_ordered(const std::vector<T>& sorted) {
+    using codec = lmdbmap::key_codec<T>;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        std::string e = encoded<codec>(sorted[i]);
+        EXPECT_EQ(codec::decode(e.data(), e.size()), sorted[i]);
+        if (i > 0) EXPECT_LT(encoded<codec>(sorted[i - 1]), e);
+    }
+}
+
+enum class color : int16_t { red = -1, green = 0, blue = 7 };
+
+struct point {
+    int32_t x;
+    int32_t y;
+    double weight;
+};
+
+}
+
+TEST(KeyCodecTest, SignedIntegers) {
+    expect_ordered<int>({std::numeric_limits<int>::min(), -70000, -256, -1, 0, 1, 255, 256, std::numeric_limits<int>::max()});
+    expect_ordered<int64_t>({std::numeric_limits<int64_t>::min(), -1, 0, 1LL << 40, std::numeric_limits<int64_t>::max()});
+    expect_ordered<int8_t>({-128, -1, 0, 127});
+}
+
+TEST(KeyCodecTest, UnsignedIntegers) {
+    expect_ordered<uint32_t>({0, 1, 255, 256, 65536, std::numeric_limits<uint32_t>::max()});
+    expect_ordered<uint64_t>({0, 1, 1ULL << 63, std::numeric_limits<uint64_t>::max()});
+    EXPECT_EQ(encoded<lmdbmap::key_codec<uint32_t>>(0x01020304u), std::string("\x01\x02\x03\x04", 4));
+}
+
+TEST(KeyCodecTest, FloatingPoint) {
+    expect_ordered<double>({-std::numeric_limits<double>::infinity(), -1e300, -2.5, -1e-300, 0.0, 1e-300, 2.5, 1e300,
+                            std::numeric_limits<double>::infinity()});
+    expect_ordered<float>({-3.5f, -0.5f, 0.0f, 0.25f, 1e20f});
+}
+
+TEST(KeyCodecTest, StringsAndEnums) {
+    expect_ordered<std::string>({"", "a", "ab", "b", std::string("b\0c", 3), "ba"});
+    expect_ordered<color>({color::red, color::green, color::blue});
+    EXPECT_EQ(encoded<lmdbmap::key_codec<std::string>>(std::string("raw")), "raw");
+}
+
+TEST(KeyCodecTest, CompositeKeys) {
+    using key = std::tuple<std::string, int32_t, double>;
+    expect_ordered<key>({{"", -5, 0.0}, {"", 7, -1.0}, {"a", -1, 2.0}, {"a", 0, -3.0}, {"a", 0, 1.5},
+                         {std::string("a\0", 2), -9, 0.0}, {"ab", -9, 0.0}, {"b", 0, 0.0}});
+    expect_ordered<std::tuple<color, uint64_t>>({{color::red, 9}, {color::green, 0}, {color::green, 1}, {color::blue, 0}});
+
+    // A prefix encodes to the leading bytes of every key that starts with it.
+    using codec = lmdbmap::key_codec<key>;
+    std::string full = encoded<codec>(key{"tenant", 42, 1.0});
+    EXPECT_EQ(full.compare(0, codec::encode_prefix("tenant").size(), codec::encode_prefix("tenant")), 0);
+    EXPECT_EQ(full.compare(0, codec::encode_prefix("tenant", 42).size(), codec::encode_prefix("tenant", 42)), 0);
+    EXPECT_NE(encoded<codec>(key{"tenant2", 42, 1.0}).compare(0, codec::encode_prefix("tenant").size(),
+                                                               codec::encode_prefix("tenant")), 0);
+
+    EXPECT_THROW(codec::decode(full.data(), full.size() - 1), std::runtime_error);
+    EXPECT_THROW(codec::decode(full.data(), 3), std::runtime_error);
+}
+
+TEST(KeyCodecTest, SizeMismatchThrows) {
+    EXPECT_THROW(lmdbmap::key_codec<int>::decode("abc", 3), std::runtime_error);
+}
+
+TEST(KeyCodecTest, BoostFallback) {
+    using codec = lmdbmap::key_codec<std::vector<int>>;
+    std::vector<int> v{3, 1, 2};
+    std::string e = encoded<codec>(v);
+    EXPECT_EQ(codec::decode(e.data(), e.size()), v);
+}
+
+TEST(ValueCodecTest, TriviallyCopyableIsRawBytes) {
+    using codec = lmdbmap::value_codec<point>;
+    point p{3, -4, 0.5};
+    auto bytes = codec::encode(p);
+    EXPECT_EQ(bytes.size(), sizeof(point));
+    EXPECT_EQ(static_cast<const void*>(bytes.data()), static_cast<const void*>(&p));
+
+    point q = codec::decode(bytes.data(), bytes.size());
+    EXPECT_EQ(q.x, 3);
+    EXPECT_EQ(q.y, -4);
+    EXPECT_EQ(q.weight, 0.5);
+
+    EXPECT_THROW(codec::decode(bytes.data(), bytes.size() - 1), std::runtime_error);
+}
+
+TEST(ValueCodecTest, StringIsRawBytes) {
+    EXPECT_EQ(encoded<lmdbmap::value_codec<std::string>>(std::string("hello")), "hello");
+}
+
+TEST(ValueCodecTest, BoostFallback) {
+    using codec = lmdbmap::value_codec<std::vector<std::string>>;
+    std::vector<std::string> v{"a", "bc"};
+    std::string e = encoded<codec>(v);
+    EXPECT_EQ(codec::decode(e.data(), e.size()), v);
+}
+
+TEST(ValueCodecTest, BoostEncodesOnce) {
+    // Sizing a Boost archive means serializing it, so the fallback must not
+    // take the MDB_RESERVE path and serialize every value twice.
+    using codec = lmdbmap::value_codec<std::vector<std::string>>;
+    static_assert(!lmdbmap::detail::has_encode_into<codec, std::vector<std::string>>::value);
+
+    std::vector<std::string> v{"a", "bc"};
+    std::string out;
+    codec::encode_to(v, out);
+    EXPECT_EQ(out, lmdbmap::serialize(v));
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/sharded_map.hpp>
+#include <lmdbmap/multimap.hpp>
+#include <lmdbmap/fixed_multimap.hpp>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ShardedMapTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_sharded");
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all("test_db_sharded");
+    }
+};
+
+TEST_F(ShardedMapTest, RoutesKeysToShards) {
+    {
+        lmdbmap::sharded_map<int, std::string> m("test_db_sharded", 4);
+        std::vector<std::pair<int, std::string>> batch;
+        for (int i = 0; i < 1000; ++i) batch.emplace_back(i, std::to_string(i));
+        m.put_many(batch);
+        m.put(2000, "single");
+        EXPECT_FALSE(m.insert(2000, "again"));
+        EXPECT_EQ(m.size(), 1001u);
+
+        // Every key lives in exactly the shard it hashes to, and each shard
+        // got a share.
+        for (size_t s = 0; s < m.shard_count(); ++s) {
+            lmdbmap::transaction txn(m.env(s), true);
+            size_t n = 0;
+            for (auto it = m.shard(s).begin(txn); it != m.shard(s).end(txn); ++it, ++n) {
+                EXPECT_EQ(m.shard_of(it.key()), s);
+            }
+            EXPECT_GT(n, 150u);
+        }
+
+        auto found = m.get_many({999, -1, 0, 2000, 500});
+        ASSERT_EQ(found.size(), 5u);
+        EXPECT_EQ(found[0], "999");
+        EXPECT_FALSE(found[1].has_value());
+        EXPECT_EQ(found[2], "0");
+        EXPECT_EQ(found[3], "single");
+        EXPECT_EQ(found[4], "500");
+
+        m.erase_many({0, 1, 2});
+        m.erase(2000);
+        EXPECT_FALSE(m.get(1).has_value());
+        EXPECT_EQ(m.get(3), "3");
+
+        size_t s = m.shard_of(7);
+        m.transact(s, [&](lmdbmap::transaction& txn, auto& shard) { shard.put(txn, 7, "seven"); });
+        EXPECT_EQ(m.get(7), "seven");
+    }
+
+    lmdbmap::sharded_map<int, std::string> reopened("test_db_sharded", 4);
+    EXPECT_EQ(reopened.size(), 997u);
+    EXPECT_THROW((lmdbmap::sharded_map<int, std::string>("test_db_sharded", 8)), std::runtime_error);
+}
+
+TEST_F(ShardedMapTest, ForEachMergesInKeyOrder) {
+    lmdbmap::sharded_map<int, int> m("test_db_sharded", 3);
+    std::vector<std::pair<int, int>> batch;
+    for (int i = -2000; i < 2000; i += 2) batch.emplace_back(i, i * 10);
+    m.put_many(batch);
+
+    std::vector<int> keys;
+    m.for_each([&](const std::pair<int, int>& e) {
+        EXPECT_EQ(e.second, e.first * 10);
+        keys.push_back(e.first);
+    });
+    ASSERT_EQ(keys.size(), batch.size());
+    for (size_t i = 0; i < keys.size(); ++i) EXPECT_EQ(keys[i], batch[i].first);
+
+    keys.clear();
+    m.for_each(-11, 11, [&](const std::pair<int, int>& e) { keys.push_back(e.first); });
+    EXPECT_EQ(keys, (std::vector<int>{-10, -8, -6, -4, -2, 0, 2, 4, 6, 8, 10}));
+
+    // Stopping early unblocks the scanning threads.
+    int seen = 0;
+    EXPECT_THROW(m.for_each([&](const std::pair<int, int>&) {
+        if (++seen == 10) throw std::runtime_error("enough");
+    }), std::runtime_error);
+    EXPECT_EQ(seen, 10);
+}
+
+TEST_F(ShardedMapTest, ConcurrentWriters) {
+    lmdbmap::sharded_map<int, int> m("test_db_sharded", 4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 50; ++i) {
+                std::vector<std::pair<int, int>> batch;
+                for (int j = 0; j < 20; ++j) batch.emplace_back(t * 100000 + i * 100 + j, t);
+                m.put_many(batch);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(m.size(), 4u * 50 * 20);
+    EXPECT_EQ(m.get(300000 + 4900 + 19), 3);
+}
+
+TEST_F(ShardedMapTest, ReopensReadOnlyAndChecksShardOrder) {
+    {
+        lmdbmap::sharded_map<int, int> m("test_db_sharded", 3);
+        m.put_many({{1, 10}, {2, 20}, {3, 30}, {4, 40}});
+    }
+    {
+        lmdbmap::sharded_map<int, int> m("test_db_sharded", 3, "data",
+                                         lmdbmap::environment_options().flags(MDB_RDONLY));
+        EXPECT_EQ(m.get(3), 30);
+        EXPECT_EQ(m.get_many({4, 5})[0], 40);
+    }
+
+    std::filesystem::rename("test_db_sharded/shard-000", "test_db_sharded/tmp");
+    std::filesystem::rename("test_db_sharded/shard-001", "test_db_sharded/shard-000");
+    std::filesystem::rename("test_db_sharded/tmp", "test_db_sharded/shard-001");
+    try {
+        lmdbmap::sharded_map<int, int> m("test_db_sharded", 3);
+        FAIL() << "swapped shards were not detected";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find("holds shard 1, not shard 0"), std::string::npos) << e.what();
+    }
+}
+
+TEST_F(ShardedMapTest, MultimapsOpenReadOnly) {
+    {
+        lmdbmap::environment env("test_db_sharded/plain");
+        lmdbmap::multimap<int, std::string> tags(env, "tags");
+        lmdbmap::fixed_multimap<int, std::uint32_t> ids(env, "ids");
+        lmdbmap::transaction txn(env);
+        tags.insert(txn, 1, "a");
+        tags.insert(txn, 1, "b");
+        ids.insert(txn, 1, 7);
+        txn.commit();
+    }
+    lmdbmap::environment env("test_db_sharded/plain", lmdbmap::environment_options().flags(MDB_RDONLY));
+    lmdbmap::multimap<int, std::string> tags(env, "tags");
+    lmdbmap::fixed_multimap<int, std::uint32_t> ids(env, "ids");
+    lmdbmap::read_txn txn(env);
+    EXPECT_EQ(tags.get(txn, 1), (std::vector<std::string>{"a", "b"}));
+    EXPECT_EQ(ids.get(txn, 1), std::vector<std::uint32_t>{7});
+    EXPECT_THROW((lmdbmap::multimap<int, int>(env, "missing")), std::runtime_error);
+}
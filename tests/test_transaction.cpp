@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <lmdbmap/map.hpp>
+#include <lmdbmap/environment.hpp>
+#include <lmdbmap/transaction.hpp>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+class TransactionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all("test_db_txn");
+        env = std::make_unique<lmdbmap::environment>("test_db_txn");
+    }
+
+    void TearDown() override {
+        env.reset();
+        std::filesystem::remove_all("test_db_txn");
+    }
+
+    std::unique_ptr<lmdbmap::environment> env;
+};
+
+TEST_F(TransactionTest, ReadTxnIsRecycled) {
+    lmdbmap::map<int, std::string> m(*env, "txn_recycle");
+    MDB_txn* first;
+    {
+        lmdbmap::read_txn txn(*env);
+        first = txn;
+        EXPECT_FALSE(m.get(txn, 1).has_value());
+    }
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, "one");
+        txn.commit();
+    }
+    {
+        lmdbmap::read_txn txn(*env);
+        EXPECT_EQ(static_cast<MDB_txn*>(txn), first);
+        auto v = m.get(txn, 1);
+        ASSERT_TRUE(v.has_value());
+        EXPECT_EQ(*v, "one");
+    }
+}
+
+TEST_F(TransactionTest, ReadTxnKeepsCursors) {
+    lmdbmap::map<int, std::string> m(*env, "txn_cursors");
+    {
+        lmdbmap::transaction txn(*env);
+        m.put(txn, 1, "one");
+        m.put(txn, 2, "two");
+        txn.commit();
+    }
+    for (int round = 0; round < 3; ++round) {
+        lmdbmap::read_txn txn(*env);
+        auto it = m.find(txn, 2);
+        ASSERT_NE(it, m.end(txn));
+        EXPECT_EQ(it->second, "two");
+        EXPECT_EQ(m.begin(txn)->first, 1);
+    }
+}
+
+TEST_F(TransactionTest, ReadTxnAcrossThreads) {
+    lmdbmap::map<int, int> m(*env, "txn_threads");
+    {
+        lmdbmap::transaction txn(*env);
+        for (int i = 0; i < 100; ++i) m.put(txn, i, i * i);
+        txn.commit();
+    }
+    std::vector<std::thread> threads;
+    std::vector<int> failures(4, 0);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 500; ++i) {
+                lmdbmap::read_txn txn(*env);
+                auto v = m.get(txn, i % 100);
+                if (!v || *v != (i % 100) * (i % 100)) ++failures[t];
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(failures, std::vector<int>(4, 0));
+}
+
+TEST(ReadTxnNoTlsTest, SharedBetweenThreads) {
+    std::filesystem::remove_all("test_db_txn_notls");
+    {
+        lmdbmap::environment env("test_db_txn_notls", 104857600, 10, MDB_NOTLS);
+        lmdbmap::map<int, int> m(env, "notls");
+        {
+            lmdbmap::transaction txn(env);
+            m.put(txn, 1, 10);
+            txn.commit();
+        }
+        MDB_txn* used = nullptr;
+        std::thread([&] {
+            lmdbmap::read_txn txn(env);
+            used = txn;
+            EXPECT_EQ(m.get(txn, 1), 10);
+        }).join();
+        lmdbmap::read_txn txn(env);
+        EXPECT_EQ(static_cast<MDB_txn*>(txn), used);
+        EXPECT_EQ(m.get(txn, 1), 10);
+    }
+    std::filesystem::remove_all("test_db_txn_notls");
+}